@@ -1,3 +1,4 @@
+#include <atomic>
 #include <string>
 #include <vector>
 #include <utility>
@@ -6,6 +7,7 @@
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <global.h>
 
 void mk_sort (std::vector<int>& SA, const std::string& T, size_t l, size_t r, size_t depth);
@@ -14,6 +16,7 @@ void TSQS (std::vector<int>& SA, const std::string& T, size_t l, size_t r, size_
 void mk_buildin (std::vector<int>& SA, const std::string& T, size_t l, size_t r, size_t depth);
 
 std::vector<int> psufsort(const std::string& T);
+std::vector<int> lssort(const std::string& T);
 
 class Bucket {
 
@@ -22,20 +25,56 @@ public:
 	constexpr Bucket() noexcept : start(0), size(0) {};
 };
 
+// A pending partition of the SA: [l,r) sorted from `depth` on.
+struct Range {
+	size_t l, r, depth, calls;
+};
+
+// Partitions of at least this size are sorted as separate OpenMP tasks.
+constexpr size_t TASK_CUTOFF = 1 << 14;
+
+// Work done at a depth of at least DEEP_DEPTH characters is charged to the
+// budget. Normal text hardly ever gets there.
+constexpr size_t DEEP_DEPTH = 64;
+
+// Periodic text, such as satellites, makes multikey quicksort and the string
+// comparisons quadratic. Hence the deep work is limited to a budget linear
+// in the text length. Once it is exceeded, sorting is aborted and redone via
+// prefix doubling, see lssort().
+class Budget {
+	std::atomic<size_t> used;
+	size_t limit;
+	std::atomic<bool> exceeded;
+public:
+	Budget(size_t n) : used(0), limit(32 * n + (1 << 26)), exceeded(false) {};
+
+	void charge(size_t cost){
+		if( used.fetch_add(cost, std::memory_order_relaxed) + cost > limit){
+			exceeded.store(true, std::memory_order_relaxed);
+		}
+	}
+
+	bool is_exceeded() const {
+		return exceeded.load(std::memory_order_relaxed);
+	}
+};
+
 class PSufSort
 {
 	const std::string& T;
 	std::vector<int>& SA;
+	Budget& budget;
 	size_t threshold;
 public:
-	PSufSort(const std::string& _T, std::vector<int>& _SA, size_t size) : T(_T), SA(_SA) {
+	PSufSort(const std::string& _T, std::vector<int>& _SA, size_t size, Budget& _budget) : T(_T), SA(_SA), budget(_budget) {
 		threshold = std::log(size);
 	}
 	~PSufSort() {};
 
 	// All intervals are semi-open: [l,r)
 	void sort(size_t l, size_t r, size_t depth, size_t calls);
-	void sort_tsqs(size_t l, size_t r, size_t depth, size_t calls);
+	void sort_tsqs(size_t l, size_t r, size_t depth, size_t calls, std::vector<Range>& stack);
+	void push(size_t l, size_t r, size_t depth, size_t calls, std::vector<Range>& stack);
 	void sort_insert(size_t l, size_t r, size_t depth, size_t calls);
 	void sort_heap(size_t l, size_t	r, size_t depth, size_t calls);
 
@@ -43,6 +82,7 @@ public:
 	void heapify( int* rSA, size_t heap_size, size_t i, size_t depth);
 
 	char median3(size_t a, size_t b, size_t c, size_t depth);
+	int compare(size_t a, size_t b, size_t depth);
 
 	void swap_range(size_t a, size_t b, size_t n);
 	inline char char_at( size_t sai, size_t depth);
@@ -124,19 +164,27 @@ std::vector<int> psufsort(const std::string& T){
 	}
 
 	// sort all S* suffixes
-	#pragma omp parallel for shared(SA,T) schedule(dynamic, 1) num_threads( (FLAGS & F_LOW_MEMORY) ? THREADS : 1)
+	auto budget = Budget(n);
+
+	// Large partitions of a heavy bucket are spawned as tasks, which idle
+	// threads pick up at the end of the loop.
+	#pragma omp parallel for shared(SA,T) schedule(dynamic, 1) num_threads(THREADS)
 	for(i=0; i<256*256; i++){
 		const auto buc = bucket_SS[i];
 		if( buc.size > 1){
 			int b = buc.start;
 			int e = b + buc.size;
-			auto sorter = PSufSort( T, SA, buc.size);
+			auto sorter = PSufSort( T, SA, buc.size, budget);
 
 			// sort
 			sorter.sort( b, e, 2, 0);
 		}
 	}
 
+	if( budget.is_exceeded()){
+		return lssort(T);
+	}
+
 	// induced insert all S-
 	for(i=n; i >= 0;i--){
 		int j = SA[i];
@@ -183,41 +231,90 @@ void PSufSort::swap_range(size_t a, size_t b, size_t n){
 }
 
 void PSufSort::sort (size_t l, size_t r, size_t depth, size_t calls) {
-	if(l >= r){
-		return;
+	// An explicit stack instead of recursion; see sort_tsqs.
+	auto stack = std::vector<Range>();
+	stack.push_back({l, r, depth, calls});
+
+	while( !stack.empty() && !budget.is_exceeded()){
+		auto p = stack.back();
+		stack.pop_back();
+
+		if(p.l >= p.r){
+			continue;
+		}
+
+		auto m = p.r - p.l;
+		if( m < 2 ){
+			continue;
+		}
+
+		if (m <= 16){
+			sort_insert(p.l, p.r, p.depth, p.calls);
+			continue;
+		}
+
+		if( p.calls < threshold){
+			sort_tsqs(p.l, p.r, p.depth, p.calls, stack);
+		} else {
+			sort_heap(p.l, p.r, p.depth, p.calls);
+		}
 	}
+}
 
-	auto m = r - l;
-	if( m < 2 ){
+// Queue a partition. Large ones get sorted by a task of their own. The task
+// works on a copy of the sorter, as this one may be gone by then.
+void PSufSort::push(size_t l, size_t r, size_t depth, size_t calls, std::vector<Range>& stack){
+	if( r - l < TASK_CUTOFF){
+		stack.push_back({l, r, depth, calls});
 		return;
 	}
 
-	if (m <= 16){
-		sort_insert(l, r, depth, calls);
-		return;
+	auto sorter = *this;
+	#pragma omp task firstprivate(sorter, l, r, depth, calls)
+	sorter.sort(l, r, depth, calls);
+}
+
+// Compares the suffixes a and b from depth on, like strcmp. Deep comparisons
+// are charged to the budget; once it is exceeded, all suffixes compare equal.
+int PSufSort::compare(size_t a, size_t b, size_t depth){
+	if( a == b || budget.is_exceeded()){
+		return 0;
 	}
 
-	if( calls < threshold){
-		sort_tsqs(l, r, depth, calls);
-	} else {
-		sort_heap(l, r, depth, calls);
+	auto ta = reinterpret_cast<const unsigned char *>(T.data() + a + depth);
+	auto tb = reinterpret_cast<const unsigned char *>(T.data() + b + depth);
+
+	// As the null byte is unique, two distinct suffixes differ at the latest
+	// at the end of the shorter one. Thus the loops need no bounds check.
+	size_t k = 0;
+	while( k < 16 && ta[k] == tb[k]){
+		k++;
 	}
-}
 
+	if( k == 16){
+		// Long common prefixes are compared in chunks.
+		auto avail = T.size() + 1 - std::max(a, b) - depth;
+		while( k + 64 <= avail && memcmp(ta + k, tb + k, 64) == 0){
+			k += 64;
+		}
+		while( ta[k] == tb[k]){
+			k++;
+		}
+	}
 
-void PSufSort::sort_insert (size_t l, size_t r, size_t depth, size_t unused){
-	auto cmp_from = [&]( size_t a, size_t b){
-		auto ta = T.data()+ a +depth;
-		auto tb = T.data()+ b +depth;
+	if( depth + k >= DEEP_DEPTH){
+		budget.charge(k);
+	}
 
-		return strcmp(ta,tb);
-	};
+	return (int)ta[k] - (int)tb[k];
+}
 
+void PSufSort::sort_insert (size_t l, size_t r, size_t depth, size_t unused){
 	for(auto j = l+1; j < r; j++){
 		auto X = SA[j];
 
 		auto i = j;
-		for(; i > l && cmp_from( SA[i-1], X) > 0 ; i--){
+		for(; i > l && compare( SA[i-1], X, depth) > 0 ; i--){
 			SA[i] = SA[i-1];
 		}
 
@@ -237,7 +334,11 @@ char PSufSort::median3(size_t b, size_t a, size_t c, size_t depth){
 	return key(b);
 }
 
-void PSufSort::sort_tsqs (size_t l, size_t r, size_t depth, size_t calls){
+void PSufSort::sort_tsqs (size_t l, size_t r, size_t depth, size_t calls, std::vector<Range>& stack){
+	if( depth >= DEEP_DEPTH){
+		budget.charge(r - l);
+	}
+
 	auto K = median3(l, (r-l)/2 + l, r-1, depth); // pick K
 
 	auto a = l;
@@ -275,9 +376,9 @@ void PSufSort::sort_tsqs (size_t l, size_t r, size_t depth, size_t calls){
 	auto i = l + b - a;
 	auto j = r - d + c;
 
-	this->sort(l, i, depth, calls + 1);
-	this->sort(i, j, depth+1, calls + 1);
-	this->sort(j, r, depth, calls + 1);
+	push(l, i, depth, calls + 1, stack);
+	push(i, j, depth+1, calls + 1, stack);
+	push(j, r, depth, calls + 1, stack);
 }
 
 constexpr inline size_t LEFT(size_t i) noexcept {
@@ -300,18 +401,14 @@ void PSufSort::build_heap( int* rSA, size_t n, size_t depth){
 }
 
 void PSufSort::heapify( int* rSA, size_t heap_size, size_t i, size_t depth){ // aka. siftDown
-	auto key = [&](size_t j){
-		return T.data() + j + depth;
-	};
-
 	auto l = LEFT(i);
 	auto r = RIGHT(i);
 	auto largest = i;
 
-	if( l < heap_size && strcmp( key(rSA[l]) , key(rSA[i])) > 0 ){
+	if( l < heap_size && compare( rSA[l], rSA[i], depth) > 0 ){
 		largest = l;
 	}
-	if( r < heap_size && strcmp( key(rSA[r]) , key(rSA[largest])) > 0){
+	if( r < heap_size && compare( rSA[r], rSA[largest], depth) > 0){
 		largest = r;
 	}
 	if( largest != i){
@@ -334,3 +431,79 @@ void PSufSort::sort_heap(size_t left, size_t right, size_t depth, size_t calls){
 	}
 }
 
+// Sorts all suffixes by prefix doubling in the style of Larsson and Sadakane.
+// After sorting by the first h characters, each unsorted group is sorted by
+// the rank of the suffix h positions further, doubling h. Only unsorted
+// groups are touched and ranks are refined in place, so periodic text takes
+// O(n log n) comparisons. The resulting SA has the same layout as the one of
+// psufsort(): SA[0] = n, the empty suffix.
+std::vector<int> lssort(const std::string& T){
+	auto n = T.size();
+	auto SA = std::vector<int>(n+1);
+	// The rank of a suffix is the index of the last element of its group.
+	auto rank = std::vector<int>(n+1);
+	auto groups = std::vector<std::pair<int,int>>();
+
+	// sort by the first eight characters, including the null byte
+	auto key = [&](size_t i){
+		uint64_t k = 0;
+		for(size_t j = i; j < i + 8; j++){
+			k = (k << 8) | (j <= n ? (unsigned char)T.data()[j] : 0);
+		}
+		return k;
+	};
+
+	auto initial = std::vector<std::pair<uint64_t,int>>(n+1);
+	for(size_t i=0; i<n+1; i++){
+		initial[i] = {key(i), i};
+	}
+	std::sort(initial.begin(), initial.end());
+
+	for(size_t b=0; b<n+1;){
+		auto e = b + 1;
+		for(; e<n+1 && initial[e].first == initial[b].first; e++);
+
+		for(auto k = b; k < e; k++){
+			SA[k] = initial[k].second;
+			rank[SA[k]] = e - 1;
+		}
+		if( e - b > 1){
+			groups.push_back({b, e});
+		}
+		b = e;
+	}
+	initial = std::vector<std::pair<uint64_t,int>>();
+
+	auto keyed = std::vector<std::pair<int,int>>();
+	for(size_t h=8; !groups.empty(); h*=2){
+		auto next = std::vector<std::pair<int,int>>();
+
+		for(auto g: groups){
+			// All suffixes of a group share h characters and the null byte is
+			// unique. Thus SA[k] + h <= n.
+			keyed.clear();
+			for(auto k = g.first; k < g.second; k++){
+				keyed.push_back({rank[SA[k] + h], SA[k]});
+			}
+			std::sort(keyed.begin(), keyed.end());
+
+			for(size_t k=0; k<keyed.size();){
+				auto e = k + 1;
+				for(; e<keyed.size() && keyed[e].first == keyed[k].first; e++);
+
+				for(auto m = k; m < e; m++){
+					SA[g.first + m] = keyed[m].second;
+					rank[keyed[m].second] = g.first + e - 1;
+				}
+				if( e - k > 1){
+					next.push_back({g.first + k, g.first + e});
+				}
+				k = e;
+			}
+		}
+
+		groups = std::move(next);
+	}
+
+	return SA;
+}
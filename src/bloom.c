@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @brief A Bloom filter of the subjects k-mers
+ *
+ * When screening queries which are mostly unrelated to the subject, most
+ * lookups in the ESA end in short, non-unique matches. A k-mer that does not
+ * occur in the subject cannot be part of any MUM. This filter answers the
+ * question whether a k-mer occurs in the subject without touching the ESA.
+ * As usual for Bloom filters, there are no false negatives, but few false
+ * positives.
+ *
+ * Only k-mers consisting of ACGT are stored. Query k-mers containing other
+ * characters are conservatively reported as present.
+ *
+ * The scan uses the filter to find the part at the end of a query which
+ * shares no k-mer with the subject, see dist_anchor().
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bloom.h"
+#include "global.h"
+#include "hash.h"
+
+/** @brief The number of bits per subject k-mer. */
+static const size_t BLOOM_BITS_PER_KMER = 8;
+
+/** @brief The number of hash functions. */
+static const int BLOOM_HASHES = 3;
+
+/** @brief Map a nucleotide to a two bit code, or -1. */
+static inline int bloom_code(char c) {
+	switch (c) {
+		case 'A': return 0;
+		case 'C': return 1;
+		case 'G': return 2;
+		case 'T': return 3;
+	}
+	return -1;
+}
+
+static inline void bloom_insert(bloom_t *self, uint64_t kmer) {
+	uint64_t hash = mix64(kmer);
+	uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+
+	for (int i = 0; i < BLOOM_HASHES; i++) {
+		uint64_t bit = (h1 + i * h2) & self->mask;
+		self->bits[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+static inline int bloom_contains(const bloom_t *self, uint64_t kmer) {
+	uint64_t hash = mix64(kmer);
+	uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+
+	for (int i = 0; i < BLOOM_HASHES; i++) {
+		uint64_t bit = (h1 + i * h2) & self->mask;
+		if (!(self->bits[bit >> 6] & (1ULL << (bit & 63)))) return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Builds a Bloom filter from all k-mers of the subject.
+ *
+ * @param self - The filter to initialize.
+ * @param S - The subject.
+ * @param len - The length of the subject.
+ * @param k - The k-mer length; at most ::BLOOM_MAX_K.
+ * @returns 0 iff successful
+ */
+int bloom_init(bloom_t *self, const char *S, size_t len, size_t k) {
+	if (!self || !S || k == 0 || k > BLOOM_MAX_K) return 1;
+
+	size_t num_bits = 64;
+	while (num_bits < len * BLOOM_BITS_PER_KMER) {
+		num_bits <<= 1;
+	}
+
+	*self = (bloom_t){.mask = num_bits - 1, .k = k};
+	self->bits = calloc(num_bits / 64, sizeof(*self->bits));
+	CHECK_MALLOC(self->bits);
+
+	const uint64_t mask = k < 32 ? (1ULL << (2 * k)) - 1 : ~0ULL;
+	uint64_t kmer = 0;
+	size_t valid = 0; // number of valid characters in a row
+
+	for (size_t i = 0; i < len; i++) {
+		int code = bloom_code(S[i]);
+		if (code < 0) {
+			valid = 0;
+			continue;
+		}
+
+		kmer = ((kmer << 2) | code) & mask;
+		if (++valid >= k) {
+			bloom_insert(self, kmer);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Finds the last k-mer of a query before `end` that may occur in the
+ * subject.
+ *
+ * @param self - The filter.
+ * @param query - The query string.
+ * @param end - The k-mers starting before `end` are checked; the query must
+ * be at least `end + k - 1` characters long.
+ * @returns One past the start of the last k-mer starting before `end` which
+ * may occur in the subject, or 0 if there is none.
+ */
+size_t bloom_present_before(const bloom_t *self, const char *query,
+							size_t end) {
+	size_t k = self->k;
+	const size_t shift = 2 * (k - 1);
+	uint64_t kmer = 0;
+	size_t valid = 0; // number of valid characters in a row from p on
+
+	// all but the first character of the k-mer at end - 1
+	for (size_t i = end + k - 1; i-- > end;) {
+		int code = bloom_code(query[i]);
+		valid = code < 0 ? 0 : valid + 1;
+		kmer = (kmer >> 2) | (uint64_t)(code < 0 ? 0 : code) << shift;
+	}
+
+	for (size_t p = end; p-- > 0;) {
+		int code = bloom_code(query[p]);
+		valid = code < 0 ? 0 : valid + 1;
+		kmer = (kmer >> 2) | (uint64_t)(code < 0 ? 0 : code) << shift;
+
+		if (valid < k || bloom_contains(self, kmer)) return p + 1;
+	}
+
+	return 0;
+}
+
+/** @brief Frees the memory of a Bloom filter. */
+void bloom_free(bloom_t *self) {
+	free(self->bits);
+	*self = (bloom_t){};
+}
@@ -0,0 +1,31 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the k-mer Bloom filter in
+ * bloom.c.
+ */
+#ifndef _BLOOM_H_
+#define _BLOOM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief A Bloom filter over the k-mers of the subject.
+ */
+typedef struct bloom_s {
+	/** The bit array. */
+	uint64_t *bits;
+	/** The number of bits minus one; always a power of two minus one. */
+	uint64_t mask;
+	/** The k-mer length. */
+	size_t k;
+} bloom_t;
+
+/** @brief The maximum k-mer length supported by the Bloom filter. */
+#define BLOOM_MAX_K 32
+
+int bloom_init(bloom_t *, const char *S, size_t len, size_t k);
+size_t bloom_present_before(const bloom_t *, const char *query, size_t end);
+void bloom_free(bloom_t *);
+
+#endif // _BLOOM_H_
@@ -0,0 +1,111 @@
+/**
+ * @file
+ * @brief Occurrence counts of short strings
+ *
+ * A partial index only holds the suffixes starting with a query k-mer. It
+ * finds every match of k or more characters, but a shorter match may stop
+ * early or appear unique although it is not. To answer such lookups exactly,
+ * the occurrences of every string shorter than k are counted, up to two.
+ *
+ * Only strings over ACGT are counted. The strings of the maximum length are
+ * counted from the subject directly. A shorter string occurs once for every
+ * occurrence of its extensions by one character, plus once at the end of
+ * every run of ACGT it ends, where it cannot be extended.
+ */
+#include <stdlib.h>
+
+#include "counts.h"
+#include "esa.h"
+#include "global.h"
+
+/** @brief Returns the count stored for `code`. */
+static unsigned get_count(const uint64_t *level, uint64_t code) {
+	return level[code >> 5] >> (2 * (code & 31)) & 3;
+}
+
+/** @brief Adds to the count stored for `code`, saturating at two. */
+static void add_count(uint64_t *level, uint64_t code, unsigned count) {
+	unsigned shift = 2 * (code & 31);
+	unsigned sum = get_count(level, code) + count;
+	if (sum > 2) sum = 2;
+
+	level[code >> 5] &= ~(3ULL << shift);
+	level[code >> 5] |= (uint64_t)sum << shift;
+}
+
+/**
+ * @brief Counts the short strings of a subject.
+ *
+ * @param self - The counts to initialize.
+ * @param S - The subject.
+ * @param len - The length of the subject.
+ * @param max_length - The maximum length of a counted string; at most
+ * ::COUNTS_MAX_LENGTH.
+ * @returns 0 iff successful
+ */
+int counts_init(counts_t *self, const char *S, size_t len,
+				size_t max_length) {
+	if (!self || !S || max_length > COUNTS_MAX_LENGTH) return 1;
+
+	*self = (counts_t){.max_length = max_length};
+	if (!max_length) return 0;
+
+	for (size_t j = 1; j <= max_length; j++) {
+		self->levels[j] = calloc(((1ULL << (2 * j)) + 31) / 32, 8);
+		CHECK_MALLOC(self->levels[j]);
+	}
+
+	const uint64_t mask = (1ULL << (2 * max_length)) - 1;
+	uint64_t code = 0;
+	size_t valid = 0;
+
+	for (size_t i = 0; i <= len; i++) {
+		ssize_t c = i < len ? char2code(S[i]) : -1;
+
+		if (c < 0) {
+			// The last strings of the run cannot be extended.
+			for (size_t j = 1; j < max_length && j <= valid; j++) {
+				add_count(self->levels[j], code & ((1ULL << (2 * j)) - 1), 1);
+			}
+			code = 0;
+			valid = 0;
+			continue;
+		}
+
+		code = ((code << 2) | c) & mask;
+		if (++valid >= max_length) {
+			add_count(self->levels[max_length], code, 1);
+		}
+	}
+
+	for (size_t j = max_length - 1; j > 0; j--) {
+		const uint64_t *longer = self->levels[j + 1];
+		for (uint64_t w = 0; w < 1ULL << (2 * j); w++) {
+			unsigned sum = 0;
+			for (uint64_t x = 0; x < 4 && sum < 2; x++) {
+				sum += get_count(longer, w << 2 | x);
+			}
+			if (sum) add_count(self->levels[j], w, sum);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Returns the number of occurrences of a string, capped at two.
+ *
+ * @param self - The counts.
+ * @param code - The two bit code of the string.
+ * @param length - The length of the string; at most `max_length`.
+ */
+int counts_get(const counts_t *self, uint64_t code, size_t length) {
+	return length ? get_count(self->levels[length], code) : 2;
+}
+
+void counts_free(counts_t *self) {
+	for (size_t j = 1; j <= self->max_length; j++) {
+		free(self->levels[j]);
+	}
+	*self = (counts_t){};
+}
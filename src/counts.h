@@ -0,0 +1,31 @@
+/**
+ * @file
+ * @brief This header contains the declarations for counting short strings in
+ * counts.c.
+ */
+#ifndef _COUNTS_H_
+#define _COUNTS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** @brief The maximum length of a counted string. */
+#define COUNTS_MAX_LENGTH 16
+
+/**
+ * @brief The number of occurrences of every string over ACGT up to a fixed
+ * length in the subject, capped at two.
+ */
+typedef struct counts_s {
+	/** The counts of the strings of length j are in `levels[j]`, two bits
+		each, indexed by the two bit code of the string. */
+	uint64_t *levels[COUNTS_MAX_LENGTH + 1];
+	/** The maximum length of a counted string. */
+	size_t max_length;
+} counts_t;
+
+int counts_init(counts_t *, const char *S, size_t len, size_t max_length);
+int counts_get(const counts_t *, uint64_t code, size_t length);
+void counts_free(counts_t *);
+
+#endif // _COUNTS_H_
@@ -0,0 +1,226 @@
+/**
+ * @file
+ * @brief Delta-aware lookups for collections of similar queries
+ *
+ * Query sets often consist of many strains of one species which differ at a
+ * few positions only. Most lookups for a query then have the very same
+ * outcome as the corresponding lookups for the previous query. Hence, the
+ * lookups of the previous query are kept together with its text.
+ *
+ * A lookup at position p of the current query corresponds to the lookup at
+ * position p + offset of the previous one. Its result is reused only if the
+ * characters it depends on are equal in both queries, see same_lookup().
+ * Thus the output is exactly that of an independent scan. After a differing
+ * region the offset is re-estimated from the subject position of the next
+ * unique match: The previous query's unique match covering the same subject
+ * position tells where the queries align again.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "delta.h"
+#include "esa.h"
+#include "global.h"
+
+/** @brief Resets a trace to hold the lookups for a new query. */
+static void trace_reset(delta_trace_t *self, const char *query, size_t len) {
+	free(self->text);
+	self->text = malloc(len + 1);
+	CHECK_MALLOC(self->text);
+	memcpy(self->text, query, len);
+	self->text[len] = '\0';
+
+	self->len = len;
+	self->size = 0;
+	self->num_unique = 0;
+}
+
+static void trace_free(delta_trace_t *self) {
+	free(self->text);
+	free(self->entries);
+	free(self->unique);
+	*self = (delta_trace_t){};
+}
+
+/** @brief Compares two matches by their subject position. */
+static int cmp_subject_pos(const void *a, const void *b) {
+	const delta_match_t *x = a, *y = b;
+	return (x->subject_pos > y->subject_pos) - (x->subject_pos < y->subject_pos);
+}
+
+/**
+ * @brief Checks whether two lookups have the same result.
+ *
+ * A lookup reads the query up to the first mismatch and, for the cache, at
+ * least `cache_length` characters. Only if the remaining query is shorter,
+ * its length matters, too.
+ *
+ * @param a - The current query from the position of the lookup.
+ * @param a_len - The remaining length of the current query.
+ * @param b - The previous query from the position of its lookup.
+ * @param b_len - The remaining length of the previous query.
+ * @param l - The match length of the previous lookup.
+ * @param cache_length - The prefix length of the LCP-interval cache.
+ * @returns 1 iff a lookup for `a` returns the same as the one for `b`.
+ */
+static int same_lookup(const char *a, size_t a_len, const char *b,
+					   size_t b_len, size_t l, size_t cache_length) {
+	size_t min_len = a_len < b_len ? a_len : b_len;
+	size_t need = l + 1 > cache_length ? l + 1 : cache_length;
+
+	if (need < min_len) {
+		return memcmp(a, b, need) == 0;
+	}
+
+	return a_len == b_len && memcmp(a, b, a_len) == 0;
+}
+
+/**
+ * @brief Finds the lookup of the previous query at position `pos`.
+ *
+ * @returns The entry or NULL if there was no lookup at this position.
+ */
+static const delta_entry_t *find_entry(const delta_trace_t *self, size_t pos) {
+	size_t lo = 0, hi = self->size;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (self->entries[mid].pos < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < self->size && self->entries[lo].pos == pos ? &self->entries[lo]
+														   : NULL;
+}
+
+/**
+ * @brief Re-estimates the offset from a unique match of the current query.
+ *
+ * @param pos - The position of the match in the current query.
+ * @param subject_pos - The position of the match in the subject.
+ */
+static void estimate_offset(delta_t *self, size_t pos, size_t subject_pos) {
+	const delta_trace_t *prev = &self->prev;
+	size_t lo = 0, hi = prev->num_unique;
+
+	// Find the last unique match starting at or before subject_pos.
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (prev->unique[mid].subject_pos <= subject_pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == 0) return;
+
+	const delta_match_t *match = &prev->unique[lo - 1];
+	size_t shift = subject_pos - match->subject_pos;
+
+	if (shift < match->length) {
+		self->offset = (ssize_t)(match->pos + shift) - (ssize_t)pos;
+	}
+}
+
+/**
+ * @brief Starts scanning a new query.
+ *
+ * @param self - The state for one strand.
+ * @param query - The query.
+ * @param len - The length of the query.
+ */
+void delta_begin(delta_t *self, const char *query, size_t len) {
+	trace_reset(&self->cur, query, len);
+	self->offset = 0;
+	self->reused = 0;
+}
+
+/**
+ * @brief Looks up the longest match at a position of the current query.
+ *
+ * If the previous query had a lookup at the corresponding position and both
+ * lookups have to return the same, its result is reused. Otherwise the ESA is
+ * searched.
+ *
+ * @param self - The state for one strand.
+ * @param C - The ESA.
+ * @param query - The current query.
+ * @param len - The length of the current query.
+ * @param pos - The position to look up.
+ * @param reused - (output parameter) Set iff a result was reused.
+ * @returns The same as `get_match_cached(C, query + pos, len - pos)`.
+ */
+lcp_inter_t delta_lookup(delta_t *self, const esa_s *C, const char *query,
+						 size_t len, size_t pos, int *reused) {
+	const delta_trace_t *prev = &self->prev;
+	delta_trace_t *cur = &self->cur;
+	const delta_entry_t *entry = NULL;
+	lcp_inter_t inter;
+
+	ssize_t prev_pos = (ssize_t)pos + self->offset;
+	if (prev_pos >= 0 && (size_t)prev_pos < prev->len) {
+		entry = find_entry(prev, prev_pos);
+	}
+
+	if (entry && same_lookup(query + pos, len - pos, prev->text + prev_pos,
+							 prev->len - prev_pos,
+							 entry->inter.l <= 0 ? 0 : entry->inter.l,
+							 C->cache_length)) {
+		inter = entry->inter;
+		self->reused++;
+		*reused = 1;
+	} else {
+		inter = get_match_cached(C, query + pos, len - pos);
+		*reused = 0;
+
+		if (inter.i == inter.j && inter.l > 0) {
+			estimate_offset(self, pos, C->SA[inter.i]);
+		}
+	}
+
+	if (cur->size == cur->capacity) {
+		cur->capacity = cur->capacity ? cur->capacity * 2 : 1024;
+		cur->entries =
+			reallocarray(cur->entries, cur->capacity, sizeof(*cur->entries));
+		CHECK_MALLOC(cur->entries);
+	}
+
+	cur->entries[cur->size++] = (delta_entry_t){.pos = pos, .inter = inter};
+
+	if (inter.i == inter.j && inter.l > 0) {
+		if (cur->num_unique == cur->unique_capacity) {
+			cur->unique_capacity =
+				cur->unique_capacity ? cur->unique_capacity * 2 : 1024;
+			cur->unique = reallocarray(cur->unique, cur->unique_capacity,
+									   sizeof(*cur->unique));
+			CHECK_MALLOC(cur->unique);
+		}
+
+		cur->unique[cur->num_unique++] = (delta_match_t){
+			.subject_pos = C->SA[inter.i], .pos = pos, .length = inter.l};
+	}
+
+	return inter;
+}
+
+/**
+ * @brief Finishes the current query. It becomes the previous one for the next
+ * query.
+ */
+void delta_end(delta_t *self) {
+	delta_trace_t *cur = &self->cur;
+	qsort(cur->unique, cur->num_unique, sizeof(*cur->unique), cmp_subject_pos);
+
+	delta_trace_t tmp = self->prev;
+	self->prev = self->cur;
+	self->cur = tmp;
+}
+
+void delta_free(delta_t *self) {
+	trace_free(&self->prev);
+	trace_free(&self->cur);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the delta-aware lookups in
+ * delta.c.
+ */
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "esa.h"
+
+/** @brief A lookup made for a query. */
+typedef struct delta_entry_s {
+	/** The position in the query. */
+	size_t pos;
+	/** The result of the lookup. */
+	lcp_inter_t inter;
+} delta_entry_t;
+
+/** @brief A unique match of a query. */
+typedef struct delta_match_s {
+	size_t subject_pos, pos, length;
+} delta_match_t;
+
+/** @brief The lookups made for one query. */
+typedef struct delta_trace_s {
+	/** A copy of the query. */
+	char *text;
+	size_t len;
+	/** The lookups in ascending order of their query position. */
+	delta_entry_t *entries;
+	size_t size, capacity;
+	/** The unique matches; finally sorted by their subject position. */
+	delta_match_t *unique;
+	size_t num_unique, unique_capacity;
+} delta_trace_t;
+
+/**
+ * @brief The state of the delta-aware lookups for one strand.
+ *
+ * While a query is scanned, the lookups of the previous query are reused
+ * where their outcome is known to be the same.
+ */
+typedef struct delta_s {
+	/** The previous query and the current one. */
+	delta_trace_t prev, cur;
+	/** The estimated offset of a position in the previous query relative to
+	 * the same position in the current one. */
+	ssize_t offset;
+	/** The number of reused lookups for the current query. */
+	size_t reused;
+} delta_t;
+
+void delta_begin(delta_t *, const char *query, size_t len);
+lcp_inter_t delta_lookup(delta_t *, const esa_s *C, const char *query,
+						 size_t len, size_t pos, int *reused);
+void delta_end(delta_t *);
+void delta_free(delta_t *);
+
+#endif // _DELTA_H_
@@ -0,0 +1,236 @@
+/**
+ * @file
+ * @brief Dot plots of all MUMs
+ *
+ * With `--dotplot FILE`, no MUMs are printed. Instead, they are accumulated
+ * into a grid of ::DOTPLOT_BINS by ::DOTPLOT_BINS cells: the reference along
+ * the x-axis and all queries, concatenated in input order, along the y-axis.
+ * Each cell counts the matched bases falling into it. MUMs of the reverse
+ * complement are mapped back to forward coordinates, so inversions show as
+ * anti-diagonals.
+ *
+ * Every process accumulates into its own tile. A worker process sends the
+ * cells touched by a query to the coordinator, which merges them into its
+ * tile, see run_workers(). Finally, the grid is written as a binary PGM image
+ * if FILE ends in `.pgm` and as a tab separated matrix otherwise.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dotplot.h"
+#include "global.h"
+
+/** @brief A cell as sent from a worker to the coordinator. */
+typedef struct cell_s {
+	uint64_t index, bases;
+} cell_t;
+
+/** @brief The tile of this process. */
+static struct {
+	uint64_t *cells;
+	size_t bins_S, bins_Q;
+	size_t len_S, len_Q;
+	/** The offset of every sequence on the query axis. */
+	size_t *offsets;
+	const seq_t *sequences;
+	/** With tracking, the indices of the cells touched since the last
+	 * dotplot_flush(). */
+	size_t *touched;
+	size_t num_touched;
+	int track;
+} TILE;
+
+/** @brief Returns the bin of `pos` on an axis of `len` positions. */
+static size_t bin_of(size_t pos, size_t len, size_t bins) {
+	return (uint64_t)pos * bins / len;
+}
+
+/** @brief Returns the first position of bin `b`. */
+static size_t bin_start(size_t b, size_t len, size_t bins) {
+	return ((uint64_t)b * len + bins - 1) / bins;
+}
+
+/**
+ * @brief Sets up the tile of this process.
+ *
+ * @param sequences - All sequences; the first one is the subject.
+ * @param n - The number of sequences.
+ * @param track - Iff set, touched cells are remembered for dotplot_flush().
+ */
+void dotplot_begin(const seq_t *sequences, size_t n, int track) {
+	TILE.sequences = sequences;
+	TILE.len_S = sequences[0].len;
+	TILE.track = track;
+
+	TILE.offsets = malloc(n * sizeof(*TILE.offsets));
+	CHECK_MALLOC(TILE.offsets);
+
+	size_t len_Q = 0;
+	for (size_t j = 1; j < n; j++) {
+		TILE.offsets[j] = len_Q;
+		len_Q += sequences[j].len;
+	}
+	TILE.len_Q = len_Q;
+
+	// Never use more bins than positions.
+	TILE.bins_S = TILE.len_S < DOTPLOT_BINS ? TILE.len_S : DOTPLOT_BINS;
+	TILE.bins_Q = len_Q < DOTPLOT_BINS ? len_Q : DOTPLOT_BINS;
+	if (!TILE.bins_S) TILE.bins_S = 1;
+	if (!TILE.bins_Q) TILE.bins_Q = 1;
+
+	TILE.cells = calloc(TILE.bins_S * TILE.bins_Q, sizeof(*TILE.cells));
+	CHECK_MALLOC(TILE.cells);
+
+	if (track) {
+		TILE.touched = malloc(TILE.bins_S * TILE.bins_Q * sizeof(size_t));
+		CHECK_MALLOC(TILE.touched);
+	}
+}
+
+/** @brief Adds `bases` to a cell. */
+static void add_cell(size_t index, uint64_t bases) {
+	if (TILE.track && !TILE.cells[index]) {
+		TILE.touched[TILE.num_touched++] = index;
+	}
+
+	TILE.cells[index] += bases;
+}
+
+/**
+ * @brief Adds a MUM to the tile.
+ *
+ * The diagonal of the MUM is cut into runs of bases falling into the same
+ * cell; each run is added at once.
+ *
+ * @param query - The query of the MUM; one of the sequences of
+ * dotplot_begin().
+ * @param pos_S - The position in the subject.
+ * @param pos_Q - The position in the query, or in its reverse complement.
+ * @param length - The length of the MUM.
+ * @param reverse - Iff set, the MUM is on the reverse complement.
+ */
+void dotplot_add(const seq_t *query, size_t pos_S, size_t pos_Q, size_t length,
+				 int reverse) {
+	const size_t bins_S = TILE.bins_S, bins_Q = TILE.bins_Q;
+	const size_t offset = TILE.offsets[query - TILE.sequences];
+
+	// the position on the query axis of the first base
+	size_t q = offset + (reverse ? query->len - 1 - pos_Q : pos_Q);
+	size_t s = pos_S;
+
+	while (length && s < TILE.len_S) {
+		size_t b_S = bin_of(s, TILE.len_S, bins_S);
+		size_t b_Q = bin_of(q, TILE.len_Q, bins_Q);
+
+		// the number of bases until either bin changes
+		size_t run = bin_start(b_S + 1, TILE.len_S, bins_S) - s;
+		size_t run_Q = reverse ? q - bin_start(b_Q, TILE.len_Q, bins_Q) + 1
+							   : bin_start(b_Q + 1, TILE.len_Q, bins_Q) - q;
+		if (run_Q < run) run = run_Q;
+		if (length < run) run = length;
+
+		add_cell(b_Q * bins_S + b_S, run);
+
+		s += run;
+		length -= run;
+		q = reverse ? q - run : q + run;
+	}
+}
+
+/**
+ * @brief Writes the cells touched since the last call as ::cell_t records and
+ * clears them. Used by worker processes.
+ */
+void dotplot_flush(FILE *out) {
+	for (size_t k = 0; k < TILE.num_touched; k++) {
+		size_t index = TILE.touched[k];
+		cell_t cell = {.index = index, .bases = TILE.cells[index]};
+		fwrite(&cell, sizeof(cell), 1, out);
+		TILE.cells[index] = 0;
+	}
+
+	TILE.num_touched = 0;
+}
+
+/** @brief Merges the records written by dotplot_flush() into the tile. */
+void dotplot_merge(const char *buf, size_t len) {
+	size_t num_cells = TILE.bins_S * TILE.bins_Q;
+
+	for (size_t k = 0; k + sizeof(cell_t) <= len; k += sizeof(cell_t)) {
+		cell_t cell;
+		memcpy(&cell, buf + k, sizeof(cell));
+		if (cell.index < num_cells) {
+			add_cell(cell.index, cell.bases);
+		}
+	}
+}
+
+/**
+ * @brief Writes the grid as an 8 bit PGM image. Darker means more matched
+ * bases, on a logarithmic scale; the query axis points down.
+ */
+static void write_pgm(FILE *file) {
+	size_t num_cells = TILE.bins_S * TILE.bins_Q;
+
+	uint64_t max = 0;
+	for (size_t k = 0; k < num_cells; k++) {
+		if (TILE.cells[k] > max) max = TILE.cells[k];
+	}
+
+	fprintf(file, "P5\n%zu %zu\n255\n", TILE.bins_S, TILE.bins_Q);
+
+	double scale = max ? 255.0 / log1p(max) : 0.0;
+	for (size_t k = 0; k < num_cells; k++) {
+		putc(255 - (int)lround(log1p(TILE.cells[k]) * scale), file);
+	}
+}
+
+/** @brief Writes the grid as a matrix; one line per query bin. */
+static void write_matrix(FILE *file) {
+	for (size_t b_Q = 0; b_Q < TILE.bins_Q; b_Q++) {
+		const uint64_t *row = TILE.cells + b_Q * TILE.bins_S;
+
+		for (size_t b_S = 0; b_S < TILE.bins_S; b_S++) {
+			fprintf(file, b_S ? "\t%llu" : "%llu",
+					(unsigned long long)row[b_S]);
+		}
+
+		putc('\n', file);
+	}
+}
+
+/** @brief Writes the grid to `file_name`; as an image if it ends in `.pgm`. */
+void dotplot_write(const char *file_name) {
+	FILE *file = fopen(file_name, "w");
+	if (!file) {
+		err(errno, "%s", file_name);
+	}
+
+	size_t len = strlen(file_name);
+	if (len >= 4 && !strcmp(file_name + len - 4, ".pgm")) {
+		write_pgm(file);
+	} else {
+		write_matrix(file);
+	}
+
+	if (fclose(file)) {
+		err(errno, "%s", file_name);
+	}
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Wrote a dot plot of %zu x %zu bins to %s\n",
+				TILE.bins_S, TILE.bins_Q, file_name);
+	}
+}
+
+/** @brief Frees the tile. */
+void dotplot_end(void) {
+	free(TILE.cells);
+	free(TILE.offsets);
+	free(TILE.touched);
+	memset(&TILE, 0, sizeof(TILE));
+}
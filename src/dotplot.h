@@ -0,0 +1,20 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the dot plot raster in
+ * dotplot.c.
+ */
+#ifndef _DOTPLOT_H_
+#define _DOTPLOT_H_
+
+#include <stdio.h>
+#include "sequence.h"
+
+void dotplot_begin(const seq_t *sequences, size_t n, int track);
+void dotplot_add(const seq_t *query, size_t pos_S, size_t pos_Q, size_t length,
+				 int reverse);
+void dotplot_flush(FILE *out);
+void dotplot_merge(const char *buf, size_t len);
+void dotplot_write(const char *file_name);
+void dotplot_end(void);
+
+#endif // _DOTPLOT_H_
@@ -18,6 +18,8 @@
 #include <assert.h>
 #include "esa.h"
 #include "global.h"
+#include "rmq.h"
+#include "sparse.h"
 
 static void esa_init_cache_dfs(esa_s *, char *str, size_t pos, lcp_inter_t in);
 static void esa_init_cache_fill(esa_s *, char *str, size_t pos, lcp_inter_t in);
@@ -25,16 +27,52 @@ static void esa_init_cache_fill(esa_s *, char *str, size_t pos, lcp_inter_t in);
 static lcp_inter_t get_interval(const esa_s *, lcp_inter_t ij, char a);
 lcp_inter_t get_match(const esa_s *, const char *query, size_t qlen);
 static lcp_inter_t get_match_from(const esa_s *, const char *query, size_t qlen,
-								  saidx_t k, lcp_inter_t ij);
+								  saidx_t k, lcp_inter_t ij, saidx_t known);
 
 static int esa_init_SA(esa_s *);
+static int esa_init_SA_qsort(esa_s *);
 static int esa_init_LCP(esa_s *);
 static int esa_init_CLD(esa_s *);
 
-/** @brief The prefix length up to which LCP-intervals are cached. */
-const size_t CACHE_LENGTH = 10;
+/** @brief The nucleotides; 4^10 cache entries. */
+const alphabet_t DNA_ALPHABET = {
+	.letters = "ACGT",
+	.size = 4,
+	.bits = 2,
+	.cache_length = 10,
+	.code = {['A'] = 1, ['C'] = 2, ['G'] = 3, ['T'] = 4}};
+
+/** @brief The amino acids. With five bits per letter, a depth of four takes
+ * as many cache entries as DNA. */
+const alphabet_t PROTEIN_ALPHABET = {
+	.letters = PROTEIN_LETTERS,
+	.size = 20,
+	.bits = 5,
+	.cache_length = 4,
+	.code = {['A'] = 1,  ['C'] = 2,  ['D'] = 3,  ['E'] = 4,  ['F'] = 5,
+			 ['G'] = 6,  ['H'] = 7,  ['I'] = 8,  ['K'] = 9,  ['L'] = 10,
+			 ['M'] = 11, ['N'] = 12, ['P'] = 13, ['Q'] = 14, ['R'] = 15,
+			 ['S'] = 16, ['T'] = 17, ['V'] = 18, ['W'] = 19, ['Y'] = 20}};
+
+/** @brief Returns the alphabet selected by the flags. */
+const alphabet_t *esa_alphabet(void) {
+	return FLAGS & F_PROTEIN ? &PROTEIN_ALPHABET : &DNA_ALPHABET;
+}
+
+/** @brief Returns the cache depth for an alphabet; see ::CACHE_DEPTH. */
+size_t esa_cache_length(const alphabet_t *alphabet) {
+	return CACHE_DEPTH ? CACHE_DEPTH : alphabet->cache_length;
+}
+
+/** @brief Returns the number of cache entries of an ESA. */
+static size_t cache_size(const esa_s *C) {
+	return (size_t)1 << (C->alphabet->bits * C->cache_length);
+}
 
-/** @brief Map a code to the character. */
+/** @brief Counts, per thread, the lookups starting from a cached interval. */
+__thread esa_cache_stats_t ESA_CACHE_STATS = {0, 0};
+
+/** @brief Map a code to the nucleotide. */
 char code2char(ssize_t code) {
 	switch (code & 0x3) {
 		case 0: return 'A';
@@ -64,20 +102,31 @@ ssize_t char2code(const char c) {
  *
  * Traversing the virtual suffix tree, created by SA, LCP and CLD is rather
  * slow. Hence we create a cache, holding the LCP-interval for a prefix of a
- * certain length ::CACHE_LENGTH. This function it the entry point for the
+ * certain length, see ::alphabet_t. This function it the entry point for the
  * cache filling routine.
  *
  * @param self - The ESA.
  * @returns 0 iff successful
  */
 int esa_init_cache(esa_s *self) {
-	lcp_inter_t *cache = malloc((1 << (2 * CACHE_LENGTH)) * sizeof(*cache));
+	size_t size = cache_size(self);
+
+	// Codes unused by the alphabet leave gaps which are never looked up.
+	lcp_inter_t *cache = calloc(size, sizeof(*cache));
 	CHECK_MALLOC(cache);
 
 	self->cache = cache;
 
-	char str[CACHE_LENGTH + 1];
-	str[CACHE_LENGTH] = '\0';
+	if (FLAGS & F_LAZY_CACHE) {
+		// Entries are computed on first use; see cache_lookup_lazy(). Until
+		// then, the pages of the cache are not even mapped.
+		self->cache_state = calloc((size + 31) / 32, sizeof(uint64_t));
+		CHECK_MALLOC(self->cache_state);
+		return 0;
+	}
+
+	char str[self->cache_length + 1];
+	str[self->cache_length] = '\0';
 
 	saidx_t m = L(self->CLD, self->len);
 	lcp_inter_t ij = {.i = 0, .j = self->len - 1, .m = m, .l = self->LCP[m]};
@@ -100,28 +149,33 @@ int esa_init_cache(esa_s *self) {
  * @param in - The LCP-interval of prefix[0..pos-1].
  */
 void esa_init_cache_dfs(esa_s *C, char *str, size_t pos, const lcp_inter_t in) {
+	const alphabet_t *alphabet = C->alphabet;
+	const size_t cache_length = C->cache_length;
+
 	// we are not yet done, but the current strings do not exist in the subject.
-	if (pos < CACHE_LENGTH && in.i == -1 && in.j == -1) {
+	if (pos < cache_length && in.i == -1 && in.j == -1) {
 		esa_init_cache_fill(C, str, pos, in);
 		return;
 	}
 
 	// we are past the caching length
-	if (pos >= CACHE_LENGTH) {
+	if (pos >= cache_length) {
 		esa_init_cache_fill(C, str, pos, in);
 		return;
 	}
 
 	lcp_inter_t ij;
 
-	// iterate over all nucleotides
-	for (int code = 0; code < 4; ++code) {
-		str[pos] = code2char(code);
+	// iterate over all letters
+	for (size_t code = 0; code < alphabet->size; ++code) {
+		str[pos] = alphabet->letters[code];
 		ij = get_interval(C, in, str[pos]);
 
-		// fail early
+		/* fail early. The string str[0..pos] does not appear in the subject,
+		 * but str[0..pos-1] does. Store the interval of the latter, so a
+		 * lookup can resume from there instead of starting at the root. */
 		if (ij.i == -1 && ij.j == -1) {
-			esa_init_cache_fill(C, str, pos + 1, ij);
+			esa_init_cache_fill(C, str, pos + 1, in);
 			continue;
 		}
 
@@ -134,7 +188,7 @@ void esa_init_cache_dfs(esa_s *C, char *str, size_t pos, const lcp_inter_t in) {
 
 		// The LCP-interval is deeper than expected
 		// Check if it still fits into the cache
-		if ((size_t)ij.l >= CACHE_LENGTH) {
+		if ((size_t)ij.l >= cache_length) {
 			// If the lcp-interval exceeds the cache depth, stop here and fill
 			esa_init_cache_fill(C, str, pos + 1, in);
 			continue;
@@ -155,10 +209,10 @@ void esa_init_cache_dfs(esa_s *C, char *str, size_t pos, const lcp_inter_t in) {
 		size_t k = pos + 1;
 		for (; k < (size_t)ij.l; k++) {
 			// In some very edgy edge cases the lcp-interval `ij`
-			// contains a `;` or another non-acgt character. Since we
-			// cannot cache those, break.
+			// contains a `;` or another character not in the alphabet. No
+			// query in the cache matches that far, so all of them keep `in`.
 			char c = C->S[C->SA[ij.i] + k];
-			if (char2code(c) < 0) {
+			if (!alphabet->code[(unsigned char)c]) {
 				non_acgt = 1;
 				break;
 			}
@@ -166,9 +220,7 @@ void esa_init_cache_dfs(esa_s *C, char *str, size_t pos, const lcp_inter_t in) {
 			str[k] = c;
 		}
 
-		if (non_acgt) {
-			esa_init_cache_fill(C, str, k, ij);
-		} else {
+		if (!non_acgt) {
 			esa_init_cache_dfs(C, str, k, ij);
 		}
 	}
@@ -185,16 +237,18 @@ void esa_init_cache_dfs(esa_s *C, char *str, size_t pos, const lcp_inter_t in) {
  * @param in - The LCP-interval of prefix[0..pos-1].
  */
 void esa_init_cache_fill(esa_s *C, char *str, size_t pos, lcp_inter_t in) {
-	if (pos < CACHE_LENGTH) {
-		for (int code = 0; code < 4; ++code) {
-			str[pos] = code2char(code);
+	const alphabet_t *alphabet = C->alphabet;
+
+	if (pos < C->cache_length) {
+		for (size_t code = 0; code < alphabet->size; ++code) {
+			str[pos] = alphabet->letters[code];
 			esa_init_cache_fill(C, str, pos + 1, in);
 		}
 	} else {
-		ssize_t code = 0;
-		for (size_t i = 0; i < CACHE_LENGTH; ++i) {
-			code <<= 2;
-			code |= char2code(str[i]);
+		size_t code = 0;
+		for (size_t i = 0; i < C->cache_length; ++i) {
+			code <<= alphabet->bits;
+			code |= alphabet->code[(unsigned char)str[i]] - 1;
 		}
 
 		C->cache[code] = in;
@@ -231,6 +285,149 @@ int esa_init_FVC(esa_s *self) {
 	return 0;
 }
 
+/** @brief Returns the position in suffix `i` at which `FVW[i]` starts. */
+static inline saidx_t fvw_start(const esa_s *self, saidx_t i) {
+	saidx_t lcp = self->LCP[i];
+	return lcp < 0 ? 0 : lcp;
+}
+
+/**
+ * @brief Initializes the FVW, a widened FVC.
+ *
+ * `FVW[i]` holds up to ::FVW_BASES nucleotides of suffix `SA[i]` from
+ * position `LCP[i]` on, two bits each with the first one in the highest bits.
+ * The lowest byte holds their number; the bases end early at a character other
+ * than ACGT. Descending into an interval and extending a match then mostly
+ * read these instead of the text, saving a dependent access via SA.
+ *
+ * @param self - The ESA
+ * @returns 0 iff successful
+ */
+int esa_init_FVW(esa_s *self) {
+	size_t len = self->len;
+
+	uint64_t *FVW = self->FVW = malloc(len * sizeof(*FVW));
+	CHECK_MALLOC(FVW);
+
+	const unsigned char *code = DNA_ALPHABET.code;
+
+#pragma omp parallel for num_threads(THREADS)
+	for (size_t i = 0; i < len; i++) {
+		const char *str = self->S + self->SA[i] + fvw_start(self, i);
+		uint64_t word = 0;
+		size_t n = 0;
+
+		for (; n < FVW_BASES && code[(unsigned char)str[n]]; n++) {
+			word |= (uint64_t)(code[(unsigned char)str[n]] - 1) << (62 - 2 * n);
+		}
+
+		FVW[i] = word | n;
+	}
+
+	return 0;
+}
+
+/** @brief Returns `S[SA[i] + k]`, taken from the FVW if it covers `k`. */
+static inline char suffix_char(const esa_s *self, saidx_t i, saidx_t k) {
+	if (self->FVW) {
+		uint64_t word = self->FVW[i];
+		saidx_t d = k - fvw_start(self, i);
+
+		if (d >= 0 && d < (saidx_t)(word & 0xff)) {
+			return DNA_ALPHABET.letters[word >> (62 - 2 * d) & 3];
+		}
+	}
+
+	return self->S[self->SA[i] + k];
+}
+
+/**
+ * @brief Extends a match of `query` and suffix `SA[i]` from `*k` towards `l`
+ * as far as the FVW covers it.
+ *
+ * @returns 1 iff a mismatch was found at `*k`. Otherwise `*k` is advanced to
+ * `l` or the first position not covered.
+ */
+static inline int fvw_extend(const esa_s *self, saidx_t i, const char *query,
+							 saidx_t *k, saidx_t l) {
+	uint64_t word = self->FVW[i];
+	saidx_t start = fvw_start(self, i);
+	saidx_t end = start + (saidx_t)(word & 0xff);
+	saidx_t pos = *k;
+
+	if (pos < start) return 0;
+	if (end > l) end = l;
+
+	for (; pos < end; pos++) {
+		unsigned int code = DNA_ALPHABET.code[(unsigned char)query[pos]];
+		if (code - 1 != (word >> (62 - 2 * (pos - start)) & 3)) {
+			*k = pos;
+			return 1;
+		}
+	}
+
+	*k = pos;
+	return 0;
+}
+
+/**
+ * @brief Initializes the SUS (shortest unique substring) array.
+ *
+ * `SUS[p]` is the length of the shortest substring starting at position `p`
+ * that occurs exactly once in S. It follows from the LCP values to both
+ * neighbours of the suffix in the SA. If every prefix of the suffix repeats,
+ * `SUS[p]` is 0. Thus, a string `S[p..p+l-1]` is unique iff
+ * `SUS[p] != 0 && l >= SUS[p]`. The array requires a full ESA.
+ *
+ * @param self - The ESA
+ * @returns 0 iff successful
+ */
+int esa_init_SUS(esa_s *self) {
+	if (!self || !self->SA || !self->LCP) return 1;
+
+	size_t len = self->len;
+	saidx_t *SUS = self->SUS = malloc(len * sizeof(*SUS));
+	CHECK_MALLOC(SUS);
+
+	const saidx_t *SA = self->SA;
+	const saidx_t *LCP = self->LCP;
+
+	for (size_t i = 0; i < len; i++) {
+		saidx_t l = LCP[i] > LCP[i + 1] ? LCP[i] : LCP[i + 1];
+		saidx_t sus = l < 0 ? 1 : l + 1;
+
+		SUS[SA[i]] = (size_t)SA[i] + sus <= len ? sus : 0;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Initializes the inverse SA and the range minima of the LCP.
+ *
+ * With them, get_match_next() follows suffix links. They take four bytes per
+ * position plus a fraction for the range minima and require a full ESA.
+ *
+ * @param self - The ESA
+ * @returns 0 iff successful
+ */
+int esa_init_links(esa_s *self) {
+	if (!self || !self->SA || !self->LCP) return 1;
+
+	size_t len = self->len;
+	saidx_t *ISA = self->ISA = malloc(len * sizeof(*ISA));
+	CHECK_MALLOC(ISA);
+
+	for (size_t i = 0; i < len; i++) {
+		ISA[self->SA[i]] = i;
+	}
+
+	self->RMQ = malloc(sizeof(*self->RMQ));
+	CHECK_MALLOC(self->RMQ);
+
+	return rmq_init(self->RMQ, self->LCP, len + 1);
+}
+
 /** @brief Initializes an ESA.
  *
  * This function initializes an ESA with respect to the provided sequence.
@@ -239,13 +436,28 @@ int esa_init_FVC(esa_s *self) {
  * @returns 0 iff successful
  */
 int esa_init(esa_s *C, const seq_t *S) {
+	return esa_init_with(C, S, ESA_SA_DEFAULT);
+}
+
+/** @brief Initializes an ESA using a specific suffix sorter.
+ *
+ * @param C - The ESA to initialize.
+ * @param S - The sequence
+ * @param sorter - The algorithm to build the SA with.
+ * @returns 0 iff successful
+ */
+int esa_init_with(esa_s *C, const seq_t *S, esa_sorter_t sorter) {
 	if (!C || !S || !S->S) return 1;
 
-	*C = (esa_s){.S = S->RS, .len = S->RSlen};
+	const alphabet_t *alphabet = esa_alphabet();
+	*C = (esa_s){.S = S->RS,
+				 .len = S->RSlen,
+				 .alphabet = alphabet,
+				 .cache_length = esa_cache_length(alphabet)};
 
 	int result;
 
-	result = esa_init_SA(C);
+	result = sorter == ESA_SA_QSORT ? esa_init_SA_qsort(C) : esa_init_SA(C);
 	if (result) return result;
 
 	result = esa_init_LCP(C);
@@ -257,19 +469,295 @@ int esa_init(esa_s *C, const seq_t *S) {
 	result = esa_init_FVC(C);
 	if (result) return result;
 
+	if (FLAGS & F_WIDE_FVC) {
+		result = esa_init_FVW(C);
+		if (result) return result;
+	}
+
+	result = esa_init_cache(C);
+	if (result) return result;
+
+	return 0;
+}
+
+/** @brief Identifies a saved ESA and the format version. */
+static const char ESA_MAGIC[8] = "TUMESA3";
+
+/** @brief The header of a saved ESA. */
+typedef struct esa_header_s {
+	char magic[8];
+	uint64_t len;
+	uint64_t alphabet_size;
+	uint64_t cache_length;
+	/** Iff set, the cache is filled lazily and thus not saved. */
+	uint64_t lazy_cache;
+	uint64_t saidx_size;
+} esa_header_t;
+
+/** @brief Writes `n` elements or fails. */
+static int write_array(const void *ptr, size_t size, size_t n, FILE *file) {
+	return fwrite(ptr, size, n, file) != n;
+}
+
+/** @brief Reads `n` elements into a new buffer or fails. */
+static int read_array(void *dest, size_t size, size_t n, FILE *file) {
+	void **ptr = dest;
+	*ptr = malloc(size * n);
+	CHECK_MALLOC(*ptr);
+	return fread(*ptr, size, n, file) != n;
+}
+
+/** @brief Saves a full ESA to a file.
+ *
+ * The subject string itself is not saved, and neither is a lazily filled
+ * cache. All arrays are written in native byte order; a saved ESA is only
+ * meant to be loaded on the same machine.
+ *
+ * @param C - The ESA.
+ * @param file - The file to write to.
+ * @returns 0 iff successful
+ */
+int esa_save(const esa_s *C, FILE *file) {
+	esa_header_t header = {.len = C->len,
+						   .alphabet_size = C->alphabet->size,
+						   .cache_length = C->cache_length,
+						   .lazy_cache = C->cache_state != NULL,
+						   .saidx_size = sizeof(saidx_t)};
+	memcpy(header.magic, ESA_MAGIC, sizeof(header.magic));
+
+	size_t len = C->len;
+	return write_array(&header, sizeof(header), 1, file) ||
+		   write_array(C->SA, sizeof(*C->SA), len, file) ||
+		   write_array(C->LCP, sizeof(*C->LCP), len + 1, file) ||
+		   write_array(C->CLD, sizeof(*C->CLD), len + 1, file) ||
+		   write_array(C->FVC, 1, len, file) ||
+		   (!header.lazy_cache &&
+			write_array(C->cache, sizeof(*C->cache), cache_size(C), file));
+}
+
+/** @brief Loads an ESA saved by esa_save().
+ *
+ * @param C - The ESA to initialize.
+ * @param S - The sequence the ESA was built for.
+ * @param file - The file to read from.
+ * @returns 0 iff successful. Fails if the file was saved for a different
+ * subject length or with different parameters.
+ */
+int esa_load(esa_s *C, const seq_t *S, FILE *file) {
+	const alphabet_t *alphabet = esa_alphabet();
+
+	esa_header_t header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		memcmp(header.magic, ESA_MAGIC, sizeof(header.magic)) ||
+		header.len != S->RSlen || header.alphabet_size != alphabet->size ||
+		header.cache_length != esa_cache_length(alphabet) ||
+		header.lazy_cache != !!(FLAGS & F_LAZY_CACHE) ||
+		header.saidx_size != sizeof(saidx_t)) {
+		return 1;
+	}
+
+	*C = (esa_s){.S = S->RS,
+				 .len = S->RSlen,
+				 .alphabet = alphabet,
+				 .cache_length = header.cache_length};
+
+	size_t len = C->len;
+	if (read_array(&C->SA, sizeof(*C->SA), len, file) ||
+		read_array(&C->LCP, sizeof(*C->LCP), len + 1, file) ||
+		read_array(&C->CLD, sizeof(*C->CLD), len + 1, file) ||
+		read_array(&C->FVC, 1, len, file) ||
+		(FLAGS & F_WIDE_FVC && esa_init_FVW(C)) ||
+		(header.lazy_cache
+			 ? esa_init_cache(C)
+			 : read_array(&C->cache, sizeof(*C->cache), cache_size(C),
+						  file))) {
+		esa_free(C);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int cmp_suffix(const void *a, const void *b) {
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * @brief Computes the SA by comparison sorting.
+ *
+ * This is far too slow for repetitive sequences, but simple enough to serve
+ * as a reference for the other sorters.
+ *
+ * @param C The enhanced suffix array to use. Reads C->S, fills C->SA.
+ * @returns 0 iff successful
+ */
+static int esa_init_SA_qsort(esa_s *C) {
+	if (!C || !C->S) {
+		return 1;
+	}
+
+	const char **suffixes = malloc(C->len * sizeof(*suffixes));
+	CHECK_MALLOC(suffixes);
+
+	for (saidx_t i = 0; i < C->len; i++) {
+		suffixes[i] = C->S + i;
+	}
+
+	qsort(suffixes, C->len, sizeof(*suffixes), cmp_suffix);
+
+	C->SA = malloc(C->len * sizeof(*C->SA));
+	CHECK_MALLOC(C->SA);
+
+	for (saidx_t i = 0; i < C->len; i++) {
+		C->SA[i] = suffixes[i] - C->S;
+	}
+
+	free(suffixes);
+	return 0;
+}
+
+/** @brief Initializes a partial ESA.
+ *
+ * Only some suffixes of the subject are indexed: those starting with one of
+ * the given k-mers and those whose first k characters are not all ACGT. Thus,
+ * `len` holds the number of indexed suffixes, not the length of `S`. All
+ * occurrences of a string of length k or more start with the same k-mer, and
+ * all occurrences of a string with a character other than ACGT among its
+ * first k are indexed. For matches of such strings, the lcp-intervals are as
+ * good as in a full ESA, including uniqueness. Shorter matches over ACGT may
+ * be reported too short or falsely unique; see counts_init().
+ *
+ * The suffixes are sorted with sparse_sort(), which avoids comparing long
+ * repeats character by character. Apart from one pass over the subject to
+ * select the suffixes, its time and memory grow with the selected suffixes
+ * and the repeats they start in.
+ *
+ * @param C - The ESA to initialize.
+ * @param S - The sequence
+ * @param kmers - A bit set of 4^k bits. Bit x is set iff suffixes starting
+ * with the k-mer with the two bit code x shall be indexed.
+ * @param k - The k-mer length.
+ * @returns 0 iff successful
+ */
+int esa_init_partial(esa_s *C, const seq_t *S, const uint64_t *kmers,
+					 size_t k) {
+	if (!C || !S || !S->S || !kmers || k == 0 || k > 31) return 1;
+
+	*C = (esa_s){.S = S->RS,
+				 .alphabet = &DNA_ALPHABET,
+				 .cache_length = esa_cache_length(&DNA_ALPHABET)};
+
+	const char *str = S->RS;
+	const size_t len = S->RSlen;
+	const uint64_t mask = (1ULL << (2 * k)) - 1;
+
+	saidx_t *SA = NULL;
+	size_t num_suffixes = 0, capacity = 0;
+	uint64_t kmer = 0;
+	// The position after the last character other than ACGT read so far.
+	size_t clean = 0;
+
+	for (size_t i = 0; i < len + k - 1; i++) {
+		if (i < len) {
+			ssize_t code = char2code(str[i]);
+			if (code < 0) {
+				clean = i + 1;
+			} else {
+				kmer = ((kmer << 2) | code) & mask;
+			}
+		}
+
+		if (i + 1 < k) continue;
+
+		// The window of the suffix starting at `x` ends at `i`.
+		size_t x = i + 1 - k;
+		if (clean <= x &&
+			(i >= len || !(kmers[kmer >> 6] & (1ULL << (kmer & 63))))) {
+			continue;
+		}
+
+		if (num_suffixes == capacity) {
+			capacity = capacity ? capacity * 2 : 1024;
+			SA = realloc(SA, capacity * sizeof(*SA));
+			CHECK_MALLOC(SA);
+		}
+		SA[num_suffixes++] = x;
+	}
+
+	/* An ESA needs at least one suffix. If none is selected, the whole
+	 * subject serves as a placeholder. Then its first k characters are no
+	 * query k-mer, and it cannot produce a match of length k or more. */
+	if (!num_suffixes) {
+		SA = malloc(sizeof(*SA));
+		CHECK_MALLOC(SA);
+		SA[num_suffixes++] = 0;
+	} else {
+		SA = realloc(SA, num_suffixes * sizeof(*SA));
+		CHECK_MALLOC(SA);
+	}
+
+	C->len = num_suffixes;
+	C->SA = SA;
+	saidx_t *LCP = C->LCP = malloc((num_suffixes + 1) * sizeof(*LCP));
+	CHECK_MALLOC(LCP);
+
+	if (sparse_sort(str, len, SA, LCP, num_suffixes)) return 1;
+
+	int result;
+
+	result = esa_init_CLD(C);
+	if (result) return result;
+
+	result = esa_init_FVC(C);
+	if (result) return result;
+
+	if (FLAGS & F_WIDE_FVC) {
+		result = esa_init_FVW(C);
+		if (result) return result;
+	}
+
 	result = esa_init_cache(C);
 	if (result) return result;
 
 	return 0;
 }
 
+/** @brief Returns the memory used by the index in bytes, including the text. */
+size_t esa_bytes(const esa_s *self) {
+	size_t len = self->len;
+	size_t bytes = len + 1;
+
+	bytes += len * sizeof(*self->SA);
+	bytes += (len + 1) * sizeof(*self->LCP);
+	bytes += (len + 1) * sizeof(*self->CLD);
+	bytes += len * sizeof(*self->FVC);
+	if (self->FVW) bytes += len * sizeof(*self->FVW);
+	if (self->cache) {
+		bytes += cache_size(self) * sizeof(*self->cache);
+	}
+	if (self->cache_state) {
+		bytes += (cache_size(self) + 31) / 32 * sizeof(*self->cache_state);
+	}
+	if (self->SUS) bytes += len * sizeof(*self->SUS);
+	if (self->ISA) bytes += len * sizeof(*self->ISA);
+	if (self->RMQ) bytes += rmq_bytes(self->RMQ);
+
+	return bytes;
+}
+
 /** @brief Free the private data of an ESA. */
 void esa_free(esa_s *self) {
 	free(self->SA);
 	free(self->LCP);
 	free(self->CLD);
 	free(self->cache);
+	free(self->cache_state);
 	free(self->FVC);
+	free(self->FVW);
+	free(self->SUS);
+	free(self->ISA);
+	if (self->RMQ) rmq_free(self->RMQ);
+	free(self->RMQ);
 	*self = (esa_s){};
 }
 
@@ -298,6 +786,23 @@ int esa_init_SA(esa_s *C) {
 	return result;
 }
 
+/**
+ * @brief Computes the suffix array of a string on its own, without the rest of
+ * an ESA.
+ * @param S - The string; must not contain NUL.
+ * @param len - The length of S.
+ * @returns the suffix array, or NULL on failure. The caller frees it.
+ */
+saidx_t *esa_suffix_sort(const char *S, saidx_t len) {
+	esa_s C = {.S = S, .len = len};
+	if (esa_init_SA(&C)) {
+		free(C.SA);
+		return NULL;
+	}
+
+	return C.SA;
+}
+
 /** @brief Initializes the CLD (child) array.
  *
  * See Ohlebusch.
@@ -435,14 +940,12 @@ static lcp_inter_t get_interval(const esa_s *self, lcp_inter_t ij, char a) {
 	saidx_t i = ij.i;
 	saidx_t j = ij.j;
 
-	const saidx_t *SA = self->SA;
 	const saidx_t *LCP = self->LCP;
-	const char *S = self->S;
 	const saidx_t *CLD = self->CLD;
 	const char *FVC = self->FVC;
 	// check for singleton or empty interval
 	if (i == j) {
-		if (S[SA[i] + ij.l] != a) {
+		if (suffix_char(self, i, ij.l) != a) {
 			ij.i = ij.j = -1;
 		}
 		return ij;
@@ -451,7 +954,7 @@ static lcp_inter_t get_interval(const esa_s *self, lcp_inter_t ij, char a) {
 	int m = ij.m;
 	int l = ij.l;
 
-	char c = S[SA[i] + l];
+	char c = suffix_char(self, i, l);
 	goto SoSueMe;
 
 	do {
@@ -481,7 +984,7 @@ static lcp_inter_t get_interval(const esa_s *self, lcp_inter_t ij, char a) {
 	} while (/*m != "bottom" && */ LCP[m] == l);
 
 	// final sanity check
-	if (i != ij.i ? FVC[i] == a : S[SA[i] + l] == a) {
+	if (i != ij.i ? FVC[i] == a : suffix_char(self, i, l) == a) {
 		ij.i = i;
 		ij.j = j;
 		/* Also return the length of the LCP interval including `a` and
@@ -511,10 +1014,12 @@ static lcp_inter_t get_interval(const esa_s *self, lcp_inter_t ij, char a) {
  * @param qlen - The length of the query. Should correspond to `strlen(query)`.
  * @param k - The starting index into the query.
  * @param ij - The LCP interval for the string `query[0..k]`.
+ * @param known - A prefix length of the query which is known to occur in the
+ * subject. Characters within it are not compared.
  * @returns The LCP interval for the longest prefix.
  */
 lcp_inter_t get_match_from(const esa_s *C, const char *query, size_t qlen,
-						   saidx_t k, lcp_inter_t ij) {
+						   saidx_t k, lcp_inter_t ij, saidx_t known) {
 
 	if (ij.i == -1 && ij.j == -1) {
 		return ij;
@@ -525,9 +1030,18 @@ lcp_inter_t get_match_from(const esa_s *C, const char *query, size_t qlen,
 
 		// try to extend the match. See line 513 below.
 		saidx_t p = C->SA[ij.i];
-		size_t k = ij.l;
+		size_t k = ij.l < known ? known : ij.l;
 		const char *S = (const char *)C->S;
 
+		if (C->FVW) {
+			saidx_t pos = k;
+			if (fvw_extend(C, ij.i, query, &pos, qlen)) {
+				ij.l = pos;
+				return ij;
+			}
+			k = pos;
+		}
+
 		for (; k < qlen && S[p + k]; k++) {
 			if (S[p + k] != query[k]) {
 				ij.l = k;
@@ -572,7 +1086,17 @@ lcp_inter_t get_match_from(const esa_s *C, const char *query, size_t qlen,
 		// By definition, the kth letter of the query was matched.
 		k++;
 
-		// Extend the match
+		// Skip the characters known to match.
+		if (k < known) {
+			k = known < l ? known : l;
+		}
+
+		// Extend the match, if possible without touching the text.
+		if (C->FVW && k < l && fvw_extend(C, i, query, &k, l)) {
+			res.l = k;
+			return res;
+		}
+
 		for (int p = SA[i]; k < l; k++) {
 			if (S[p + k] != query[k]) {
 				res.l = k;
@@ -605,7 +1129,118 @@ lcp_inter_t get_match(const esa_s *C, const char *query, size_t qlen) {
 	saidx_t m = L(C->CLD, C->len);
 	lcp_inter_t ij = {.i = 0, .j = C->len - 1, .m = m, .l = C->LCP[m]};
 
-	return get_match_from(C, query, qlen, 0, ij);
+	return get_match_from(C, query, qlen, 0, ij, 0);
+}
+
+/**
+ * @brief Computes the cache entry for the first `cache_length` characters of
+ * `query`, all of which are in the alphabet.
+ *
+ * This is the path of esa_init_cache_dfs() through the virtual suffix tree
+ * which leads to the query, bounded by the cache depth.
+ */
+static lcp_inter_t cache_descend(const esa_s *C, const char *query,
+								 size_t cache_length) {
+	saidx_t m = L(C->CLD, C->len);
+	lcp_inter_t in = {.i = 0, .j = C->len - 1, .m = m, .l = C->LCP[m]};
+
+	size_t pos = 0;
+	while (pos < cache_length) {
+		lcp_inter_t ij = get_interval(C, in, query[pos]);
+		if (ij.i == -1 && ij.j == -1) break;
+
+		if (ij.l <= (ssize_t)(pos + 1)) {
+			in = ij;
+			pos++;
+			continue;
+		}
+
+		if ((size_t)ij.l >= cache_length) break;
+
+		// fast forward; a character outside the alphabet mismatches, too.
+		const char *S = C->S + C->SA[ij.i];
+		size_t k = pos + 1;
+		while (k < (size_t)ij.l && S[k] == query[k]) {
+			k++;
+		}
+
+		if (k < (size_t)ij.l) break;
+
+		in = ij;
+		pos = k;
+	}
+
+	return in;
+}
+
+/**
+ * @brief Returns the entry `offset` of a lazily filled cache, computing it
+ * first if need be.
+ *
+ * Once computed, an entry is claimed and, if no other thread claimed it
+ * before, stored and published. Readers only use entries published with
+ * release semantics. Thus each entry is written exactly once and threads
+ * share all entries without locks.
+ */
+static lcp_inter_t cache_lookup_lazy(const esa_s *C, const char *query,
+									 size_t cache_length, size_t offset) {
+	uint64_t *word = &C->cache_state[offset / 32];
+	const uint64_t claimed = (uint64_t)1 << (offset % 32 * 2);
+	const uint64_t published = claimed << 1;
+
+	if (__atomic_load_n(word, __ATOMIC_ACQUIRE) & published) {
+		ESA_CACHE_STATS.hits++;
+		return C->cache[offset];
+	}
+
+	ESA_CACHE_STATS.misses++;
+	lcp_inter_t ij = cache_descend(C, query, cache_length);
+
+	if (!(__atomic_fetch_or(word, claimed, __ATOMIC_RELAXED) & claimed)) {
+		C->cache[offset] = ij;
+		__atomic_fetch_or(word, published, __ATOMIC_RELEASE);
+	}
+
+	return ij;
+}
+
+/** @brief The body of get_match_cached() for the alphabet and cache of `C`. */
+static inline lcp_inter_t
+get_match_alphabet(const esa_s *C, const alphabet_t *alphabet,
+				   size_t cache_length, int lazy, const char *query,
+				   size_t qlen) {
+	saidx_t m = L(C->CLD, C->len);
+	lcp_inter_t ij = {.i = 0, .j = C->len - 1, .m = m, .l = C->LCP[m]};
+
+	if (qlen <= cache_length) {
+		return get_match_from(C, query, qlen, 0, ij, 0);
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < cache_length; i++) {
+		unsigned int code = alphabet->code[(unsigned char)query[i]];
+		if (!code) {
+			ESA_CACHE_STATS.misses++;
+			return get_match_from(C, query, qlen, 0, ij, 0);
+		}
+
+		offset = offset << alphabet->bits | (code - 1);
+	}
+
+	if (lazy) {
+		ij = cache_lookup_lazy(C, query, cache_length, offset);
+		return get_match_from(C, query, qlen, ij.l, ij, 0);
+	}
+
+	if (C->cache[offset].i == -1 && C->cache[offset].j == -1) {
+		ESA_CACHE_STATS.misses++;
+		return get_match_from(C, query, qlen, 0, ij, 0);
+	}
+
+	ESA_CACHE_STATS.hits++;
+	ij = C->cache[offset];
+
+	return get_match_from(C, query, qlen, ij.l, ij, 0);
 }
 
 /** @brief Compute the LCP interval of a query. For a certain prefix length of
@@ -619,23 +1254,79 @@ lcp_inter_t get_match(const esa_s *C, const char *query, size_t qlen) {
  * @returns The LCP interval for the longest prefix.
  */
 lcp_inter_t get_match_cached(const esa_s *C, const char *query, size_t qlen) {
-	if (qlen <= CACHE_LENGTH) return get_match(C, query, qlen);
-
-	ssize_t offset = 0;
-	for (size_t i = 0; i < CACHE_LENGTH && offset >= 0; i++) {
-		offset <<= 2;
-		offset |= char2code(query[i]);
+	// sanity checks
+	if (!C || !query || !C->len || !C->SA || !C->LCP || !C->S || !C->CLD) {
+		return (lcp_inter_t){-1, -1, -1, -1};
 	}
 
-	if (offset < 0) {
+	// Without a cache, the search starts from the root.
+	if (!C->cache) {
 		return get_match(C, query, qlen);
 	}
 
-	lcp_inter_t ij = C->cache[offset];
+	// With a constant alphabet and depth, the compiler specializes the
+	// default DNA path.
+	if (C->alphabet == &DNA_ALPHABET &&
+		C->cache_length == DNA_ALPHABET.cache_length && !C->cache_state) {
+		return get_match_alphabet(C, &DNA_ALPHABET, DNA_ALPHABET.cache_length,
+								  0, query, qlen);
+	}
 
-	if (ij.i == -1 && ij.j == -1) {
-		return get_match(C, query, qlen);
+	return get_match_alphabet(C, C->alphabet, C->cache_length,
+							  C->cache_state != NULL, query, qlen);
+}
+
+/**
+ * @brief Compute the LCP interval of a query following a known match.
+ *
+ * Let `prev` be the result of a lookup of `query - 1`. The match of `query`
+ * then starts with that match without its first character. Instead of
+ * descending to it again, its interval is found by a suffix link: it contains
+ * the suffixes one position after those of `prev`, and the LCP array around
+ * them gives its bounds. The lookup continues from there. This requires
+ * esa_init_links().
+ *
+ * @param C - The enhanced suffix array for the subject.
+ * @param query - The query sequence.
+ * @param qlen - The length of the query.
+ * @param prev - The result of the lookup one position before `query`.
+ * @returns The LCP interval for the longest prefix.
+ */
+lcp_inter_t get_match_next(const esa_s *C, const char *query, size_t qlen,
+						   lcp_inter_t prev) {
+	// Up to the depth of the cache, a new lookup is cheaper.
+	if (prev.l <= 1 || (size_t)prev.l - 1 <= C->cache_length || !C->ISA ||
+		!C->RMQ) {
+		return get_match_cached(C, query, qlen);
+	}
+
+	const rmq_t *rmq = C->RMQ;
+	saidx_t known = prev.l - 1;
+
+	// The bounds of the interval of the known prefix.
+	saidx_t i = rmq_prev_less(rmq, C->ISA[C->SA[prev.i] + 1], known);
+	saidx_t j = rmq_next_less(rmq, C->ISA[C->SA[prev.j] + 1] + 1, known) - 1;
+
+	if (i == j) {
+		lcp_inter_t ij = {.i = i, .j = i, .l = known};
+		return get_match_from(C, query, qlen, known, ij, known);
+	}
+
+	saidx_t l = rmq_min(rmq, i + 1, j);
+	saidx_t m = rmq_next_less(rmq, i + 1, l + 1);
+	lcp_inter_t ij = {.i = i, .j = j, .m = m, .l = l};
+
+	// Match the rest of the common prefix of the interval.
+	const char *S = C->S + C->SA[i];
+	saidx_t k = known;
+	while (k < l && (size_t)k < qlen && S[k] == query[k]) {
+		k++;
+	}
+
+	if (k < l || (size_t)k == qlen) {
+		ij.l = k;
+		return ij;
 	}
 
-	return get_match_from(C, query, qlen, ij.l, ij);
+	return get_match_from(C, query, qlen, k, ij, 0);
 }
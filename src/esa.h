@@ -6,6 +6,8 @@
 #ifndef _ESA_H_
 #define _ESA_H_
 
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include "sequence.h"
 #include "config.h"
@@ -20,6 +22,9 @@ typedef int saidx_t;
 
 #endif
 
+/** @brief The number of nucleotides per entry of the FVW. */
+#define FVW_BASES 28
+
 /**
  * @brief Represents LCP-Intervals.
  *
@@ -63,13 +68,78 @@ typedef struct esa_s {
 	lcp_inter_t *cache;
 	/** The FVC array holds the character after the LCP. */
 	char *FVC;
+	/** The optional FVW array holds the packed nucleotides after the LCP;
+		see esa_init_FVW(). */
+	uint64_t *FVW;
 	/** This is the child array. */
 	saidx_t *CLD;
+	/** The optional shortest unique substring length per position of S. */
+	saidx_t *SUS;
+	/** The optional inverse suffix array; see esa_init_links(). */
+	saidx_t *ISA;
+	/** The optional range minima of the LCP; see esa_init_links(). */
+	struct rmq_s *RMQ;
+	/** The alphabet of S; determines the layout of the cache. */
+	const struct alphabet_s *alphabet;
+	/** The prefix length up to which LCP-intervals are cached. */
+	size_t cache_length;
+	/** Iff non-NULL, the cache is filled lazily. Per entry, bit 2k is set
+		once a thread claimed entry k and bit 2k+1 once it is published. */
+	uint64_t *cache_state;
 } esa_s;
 
+/**
+ * @brief An alphabet the LCP-interval cache is built for.
+ *
+ * The cache is indexed by the codes of the first `cache_length` characters of
+ * a query, `bits` bits each.
+ */
+typedef struct alphabet_s {
+	/** The letters in the order of their codes. */
+	const char *letters;
+	/** The number of letters. */
+	size_t size;
+	/** The number of bits per code. */
+	size_t bits;
+	/** The default prefix length up to which LCP-intervals are cached. */
+	size_t cache_length;
+	/** The code of every character plus one; 0 if not in the alphabet. */
+	unsigned char code[256];
+} alphabet_t;
+
+extern const alphabet_t DNA_ALPHABET, PROTEIN_ALPHABET;
+
+/** @brief Lookups that could or could not start from a cached interval. */
+typedef struct esa_cache_stats_s {
+	size_t hits, misses;
+} esa_cache_stats_t;
+
+extern __thread esa_cache_stats_t ESA_CACHE_STATS;
+
+const alphabet_t *esa_alphabet(void);
+size_t esa_cache_length(const alphabet_t *alphabet);
+ssize_t char2code(const char c);
 lcp_inter_t get_match_cached(const esa_s *, const char *query, size_t qlen);
 lcp_inter_t get_match(const esa_s *, const char *query, size_t qlen);
+lcp_inter_t get_match_next(const esa_s *, const char *query, size_t qlen,
+						   lcp_inter_t prev);
+/** @brief The algorithms to build the suffix array with. */
+typedef enum esa_sorter_e {
+	/** libdivsufsort or psufsort, whichever TUMmer was built with. */
+	ESA_SA_DEFAULT,
+	/** Plain comparison sorting; only meant as a reference. */
+	ESA_SA_QSORT,
+} esa_sorter_t;
+
 int esa_init(esa_s *, const seq_t *S);
+int esa_init_with(esa_s *, const seq_t *S, esa_sorter_t sorter);
+int esa_init_partial(esa_s *, const seq_t *S, const uint64_t *kmers, size_t k);
+int esa_init_SUS(esa_s *);
+int esa_init_links(esa_s *);
+saidx_t *esa_suffix_sort(const char *S, saidx_t len);
+size_t esa_bytes(const esa_s *);
+int esa_save(const esa_s *, FILE *file);
+int esa_load(esa_s *, const seq_t *S, FILE *file);
 void esa_free(esa_s *);
 
 #ifdef DEBUG
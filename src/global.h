@@ -9,6 +9,7 @@
 #define _GLOBAL_H_
 
 #include <err.h>
+#include <stdio.h>
 #include "config.h"
 
 /**
@@ -18,6 +19,13 @@
  */
 extern int FLAGS;
 
+/**
+ * Set once a sequence contained characters outside the alphabet. Kept apart
+ * from ::FLAGS, as sequences are normalized while the index of the subject is
+ * built in the background and reads ::FLAGS.
+ */
+extern int NON_ACGT;
+
 /**
  * The *global* variable ::THREADS contains the number of threads the program
  * should use.
@@ -33,6 +41,86 @@ extern double RANDOM_ANCHOR_PROP;
 
 extern int MIN_LENGTH;
 
+/**
+ * If set via `--query-stats`, one performance record per query and strand is
+ * written to ::QUERY_STATS.
+ */
+extern FILE *QUERY_STATS;
+
+/**
+ * If set via `--sus`, the shortest unique substring length of every position
+ * of the subject is written to ::SUS_FILE.
+ */
+extern FILE *SUS_FILE;
+
+/**
+ * If set via `--matching-stats`, the matching statistics of all queries are
+ * written to ::MATCHING_STATS instead of finding MUMs.
+ */
+extern FILE *MATCHING_STATS;
+
+/**
+ * The number of worker processes the queries are distributed over. If zero,
+ * all queries are processed by the main process.
+ */
+extern int WORKERS;
+
+/**
+ * If non-zero, consecutive MUMs on the same diagonal that are separated by at
+ * most ::BRIDGE mismatches are merged into a single gapped anchor.
+ */
+extern int BRIDGE;
+
+/**
+ * If non-zero, only the ::TOP longest MUMs of every query strand are printed,
+ * longest first; set via `--top`.
+ */
+extern size_t TOP;
+
+/**
+ * If set via `--dotplot`, no MUMs are printed; instead a dot plot of
+ * ::DOTPLOT_BINS bins per axis is written to this file, see dotplot.c.
+ */
+extern const char *DOTPLOT;
+extern size_t DOTPLOT_BINS;
+
+/**
+ * If set via `--output-dir`, the output for every query is written to its own
+ * file within this directory, see query_output().
+ */
+extern const char *OUTPUT_DIR;
+
+/**
+ * With `--manifest`, the output file of every query, indexed like the
+ * sequences; NULL otherwise. See query_output().
+ */
+extern const char **OUTPUT_FILES;
+
+/**
+ * If set via `--shm`, queries are not read from files but served via the
+ * shared memory segment of this name, see shm.c.
+ */
+extern const char *SHM_NAME;
+
+/**
+ * If set via `--metrics`, the Unix socket path or loopback port on which the
+ * server in shm.c exposes its metrics, see metrics.c.
+ */
+extern const char *METRICS_ADDRESS;
+
+/**
+ * If set via `--index-cache`, full indices are saved to and loaded from this
+ * directory, see store.c. It is limited to ::INDEX_CACHE_SIZE bytes.
+ */
+extern const char *INDEX_CACHE;
+extern size_t INDEX_CACHE_SIZE;
+
+/**
+ * If set via `--cache-depth`, the prefix length up to which LCP-intervals are
+ * cached; otherwise the default of the alphabet is used.
+ */
+extern size_t CACHE_DEPTH;
+
 /**
  * This enum contains the available flags. Please note that all
  * available options are a power of 2.
@@ -41,10 +129,18 @@ enum {
 	F_NONE = 0,
 	F_VERBOSE = 2,
 	F_EXTRA_VERBOSE = 4,
-	F_NON_ACGT = 8,
 	F_JOIN = 16,
 	F_FORWARD = 64,
 	F_REVCOMP = 128,
+	F_SKETCH = 256,
+	F_BLOOM = 512,
+	F_PARTIAL = 1024,
+	F_DELTA = 2048,
+	F_PROTEIN = 4096,
+	F_LAZY_CACHE = 8192,
+	F_WIDE_FVC = 16384,
+	F_RINDEX = 32768,
+	F_DROP_TEXT = 65536,
 };
 
 /**
@@ -0,0 +1,20 @@
+/**
+ * @file
+ * @brief Hash functions shared by the sketches and the Bloom filter.
+ */
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdint.h>
+
+/** @brief A bijective mixing function (the finalizer of SplitMix64). */
+static inline uint64_t mix64(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+#endif // _HASH_H_
@@ -27,13 +27,14 @@
  * @param file_name - The name of the file to be used for reading. The name is
  *  also used to infer the sequence name.
  * @param dsa - (output parameter) An array that holds found sequences.
+ * @param hook - Called after the joined sequence was added; may be NULL.
  */
-void read_fasta_join(const char *file_name, dsa_t *dsa) {
+void read_fasta_join(const char *file_name, dsa_t *dsa, read_hook_t hook) {
 	if (!file_name || !dsa) return;
 
 	dsa_t single;
 	dsa_init(&single);
-	read_fasta(file_name, &single);
+	read_fasta(file_name, &single, NULL);
 
 	if (dsa_size(&single) == 0) {
 		return;
@@ -58,14 +59,17 @@ void read_fasta_join(const char *file_name, dsa_t *dsa) {
 
 	dsa_push(dsa, joined);
 	dsa_free(&single);
+
+	if (hook) hook(dsa);
 }
 
 /**
  * @brief This function reads sequences from a file.
  * @param file_name - The file to read.
  * @param dsa - (output parameter) An array that holds found sequences.
+ * @param hook - Called after each sequence added to `dsa`; may be NULL.
  */
-void read_fasta(const char *file_name, dsa_t *dsa) {
+void read_fasta(const char *file_name, dsa_t *dsa, read_hook_t hook) {
 	if (!file_name || !dsa) return;
 
 	int file_descriptor =
@@ -96,6 +100,8 @@ void read_fasta(const char *file_name, dsa_t *dsa) {
 
 		dsa_push(dsa, top);
 		pfasta_seq_free(&ps);
+
+		if (hook) hook(dsa);
 	}
 
 	if (l < 0) {
@@ -107,3 +113,83 @@ fail:
 	pfasta_free(&pf);
 	close(file_descriptor);
 }
+
+/**
+ * @brief Reads a manifest for batch mode.
+ *
+ * Every line holds the path of a FASTA file and, separated by a tab, the
+ * output file for its sequences. The first entry is the reference and needs
+ * no output. Empty lines and lines starting with `#` are ignored.
+ *
+ * @param file_name - The manifest to read.
+ * @param num_entries - (output parameter) The number of entries.
+ * @returns The entries. The caller has to free them via manifest_free().
+ */
+manifest_entry_t *read_manifest(const char *file_name, size_t *num_entries) {
+	FILE *file = strcmp(file_name, "-") ? fopen(file_name, "r") : stdin;
+	if (!file) {
+		err(errno, "%s", file_name);
+	}
+
+	manifest_entry_t *entries = NULL;
+	size_t size = 0, capacity = 0;
+
+	char *line = NULL;
+	size_t line_capacity = 0;
+	ssize_t len;
+	size_t line_number = 0;
+
+	while ((len = getline(&line, &line_capacity, file)) != -1) {
+		line_number++;
+
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+
+		if (len == 0 || line[0] == '#') continue;
+
+		char *tab = strchr(line, '\t');
+		if (tab) *tab = '\0';
+
+		if (size > 0 && (!tab || tab[1] == '\0')) {
+			errx(1, "%s:%zu: Expected a query file and an output file "
+					"separated by a tab.",
+				 file_name, line_number);
+		}
+
+		if (size == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			entries = reallocarray(entries, capacity, sizeof(*entries));
+			CHECK_MALLOC(entries);
+		}
+
+		manifest_entry_t entry = {.path = strdup(line), .output = NULL};
+		CHECK_MALLOC(entry.path);
+
+		if (size > 0) {
+			entry.output = strdup(tab + 1);
+			CHECK_MALLOC(entry.output);
+		}
+
+		entries[size++] = entry;
+	}
+
+	free(line);
+	if (file != stdin) fclose(file);
+
+	if (size < 2) {
+		errx(1, "%s: A manifest needs a reference and at least one query.",
+			 file_name);
+	}
+
+	*num_entries = size;
+	return entries;
+}
+
+void manifest_free(manifest_entry_t *entries, size_t num_entries) {
+	for (size_t i = 0; i < num_entries; i++) {
+		free(entries[i].path);
+		free(entries[i].output);
+	}
+	free(entries);
+}
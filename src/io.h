@@ -16,7 +16,23 @@
 #define D(X, Y) (D[(X)*n + (Y)])
 #define M(X, Y) (M[(X)*n + (Y)])
 
-void read_fasta(const char *, dsa_t *dsa);
-void read_fasta_join(const char *, dsa_t *dsa);
+/**
+ * @brief A function called after each sequence added to the array while
+ * reading.
+ */
+typedef void (*read_hook_t)(dsa_t *dsa);
+
+/** @brief An entry of a manifest; see read_manifest(). */
+typedef struct manifest_entry_s {
+	/** The FASTA file. */
+	char *path;
+	/** The output file for its sequences; NULL for the reference. */
+	char *output;
+} manifest_entry_t;
+
+void read_fasta(const char *, dsa_t *dsa, read_hook_t hook);
+void read_fasta_join(const char *, dsa_t *dsa, read_hook_t hook);
+manifest_entry_t *read_manifest(const char *, size_t *num_entries);
+void manifest_free(manifest_entry_t *, size_t num_entries);
 
 #endif // _IO_H_
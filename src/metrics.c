@@ -0,0 +1,300 @@
+/**
+ * @file
+ * @brief Metrics of a resident process
+ *
+ * With `--metrics ADDRESS`, a thread answers every connection to ADDRESS with
+ * the current metrics in the Prometheus text format, wrapped into a minimal
+ * HTTP response. ADDRESS is either the path of a Unix socket or a port on the
+ * loopback interface.
+ *
+ * The server records each query once it is answered. Thus the lookups
+ * themselves are not slowed down, apart from counting cache hits; see
+ * ::ESA_CACHE_STATS.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "metrics.h"
+#include "shm.h"
+
+/** @brief The upper bounds of the histogram buckets in seconds. */
+static const double BUCKETS[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025,
+								 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1,
+								 2.5, 5, 10, 30, 60};
+
+#define NUM_BUCKETS (sizeof(BUCKETS) / sizeof(BUCKETS[0]))
+
+/** @brief A histogram; counts are per bucket, not cumulative. */
+typedef struct histogram_s {
+	size_t counts[NUM_BUCKETS + 1];
+	size_t count;
+	double sum;
+} histogram_t;
+
+/** @brief All metrics, guarded by `lock`. */
+static struct {
+	pthread_mutex_t lock;
+	size_t requests, invalid, overflow;
+	size_t bases, mums;
+	size_t cache_hits, cache_misses;
+	size_t index_bytes;
+	histogram_t match, wait;
+} METRICS = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/** @brief The state of the endpoint. */
+static struct {
+	pthread_t thread;
+	int started;
+	int fd;
+	/** The path of the Unix socket, or NULL. */
+	const char *path;
+} ENDPOINT = {.fd = -1};
+
+static void histogram_add(histogram_t *self, double value) {
+	size_t k = 0;
+	while (k < NUM_BUCKETS && value > BUCKETS[k]) {
+		k++;
+	}
+
+	self->counts[k]++;
+	self->count++;
+	self->sum += value;
+}
+
+static void print_histogram(FILE *out, const char *name, const char *help,
+							const histogram_t *self) {
+	fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+	size_t cumulative = 0;
+	for (size_t k = 0; k < NUM_BUCKETS; k++) {
+		cumulative += self->counts[k];
+		fprintf(out, "%s_bucket{le=\"%g\"} %zu\n", name, BUCKETS[k],
+				cumulative);
+	}
+
+	fprintf(out, "%s_bucket{le=\"+Inf\"} %zu\n", name, self->count);
+	fprintf(out, "%s_sum %.9f\n%s_count %zu\n", name, self->sum, name,
+			self->count);
+}
+
+static void print_metric(FILE *out, const char *name, const char *type,
+						 const char *help, double value) {
+	fprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name,
+			type, name, value);
+}
+
+/** @brief Prints all metrics in the Prometheus text format. */
+static void print_metrics(FILE *out) {
+	pthread_mutex_lock(&METRICS.lock);
+
+	print_metric(out, "tummer_requests_total", "counter",
+				 "Queries answered.", METRICS.requests);
+	print_metric(out, "tummer_requests_invalid_total", "counter",
+				 "Queries rejected as invalid.", METRICS.invalid);
+	print_metric(out, "tummer_requests_overflow_total", "counter",
+				 "Queries with more MUMs than records.", METRICS.overflow);
+	print_metric(out, "tummer_query_bases_total", "counter",
+				 "Bases of all queries.", METRICS.bases);
+	print_metric(out, "tummer_mums_total", "counter", "MUMs found.",
+				 METRICS.mums);
+	print_metric(out, "tummer_bases_per_second", "gauge",
+				 "Bases matched per second of matching time.",
+				 METRICS.match.sum > 0 ? METRICS.bases / METRICS.match.sum
+									   : 0.0);
+	print_metric(out, "tummer_index_bytes", "gauge",
+				 "Memory used by the index.", METRICS.index_bytes);
+	print_metric(out, "tummer_cache_hits_total", "counter",
+				 "Lookups starting from a cached interval.",
+				 METRICS.cache_hits);
+	print_metric(out, "tummer_cache_misses_total", "counter",
+				 "Lookups not starting from a cached interval.",
+				 METRICS.cache_misses);
+
+	size_t lookups = METRICS.cache_hits + METRICS.cache_misses;
+	print_metric(out, "tummer_cache_hit_ratio", "gauge",
+				 "Fraction of lookups starting from a cached interval.",
+				 lookups ? (double)METRICS.cache_hits / lookups : 0.0);
+
+	print_histogram(out, "tummer_match_seconds",
+					"Time spent matching a query.", &METRICS.match);
+	print_histogram(out, "tummer_queue_wait_seconds",
+					"Time from submission to the start of matching.",
+					&METRICS.wait);
+
+	pthread_mutex_unlock(&METRICS.lock);
+}
+
+/** @brief Answers a single connection. */
+static void serve_connection(int fd) {
+	// Read the request, if any, so the client does not see a reset.
+	struct timeval timeout = {.tv_sec = 1};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	char request[4096];
+	size_t len = 0;
+	while (len < sizeof(request) - 1) {
+		ssize_t check = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+		if (check <= 0) break;
+		len += check;
+		request[len] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+	}
+
+	char *body = NULL;
+	size_t body_len = 0;
+	FILE *out = open_memstream(&body, &body_len);
+	if (!out) return;
+	print_metrics(out);
+	fclose(out);
+
+	char *head = NULL;
+	int head_len = asprintf(&head,
+							"HTTP/1.0 200 OK\r\n"
+							"Content-Type: text/plain; version=0.0.4\r\n"
+							"Content-Length: %zu\r\n\r\n",
+							body_len);
+
+	if (head_len >= 0) {
+		send(fd, head, head_len, MSG_NOSIGNAL);
+		send(fd, body, body_len, MSG_NOSIGNAL);
+	}
+
+	free(head);
+	free(body);
+}
+
+static void *endpoint_main(void *unused) {
+	(void)unused;
+
+	for (;;) {
+		int fd = accept(ENDPOINT.fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+
+		serve_connection(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+/** @brief Binds a socket to a Unix socket path or a loopback port. */
+static int endpoint_bind(const char *address) {
+	int fd;
+
+	if (strchr(address, '/')) {
+		struct sockaddr_un addr = {.sun_family = AF_UNIX};
+		if (strlen(address) >= sizeof(addr.sun_path)) {
+			errx(1, "The socket path %s is too long.", address);
+		}
+		strcpy(addr.sun_path, address);
+
+		// Remove a stale socket, but nothing else.
+		struct stat st;
+		if (stat(address, &st) == 0 && S_ISSOCK(st.st_mode)) {
+			unlink(address);
+		}
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			err(errno, "%s", address);
+		}
+
+		ENDPOINT.path = address;
+	} else {
+		char *end;
+		errno = 0;
+		long unsigned int port = strtoul(address, &end, 10);
+		if (errno || end == address || *end != '\0' || port == 0 ||
+			port > 65535) {
+			errx(1, "Expected a socket path or a port for --metrics, but "
+					"'%s' was given.",
+				 address);
+		}
+
+		struct sockaddr_in addr = {.sin_family = AF_INET,
+								   .sin_port = htons(port),
+								   .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int one = 1;
+		if (fd < 0 ||
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+			bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			err(errno, "127.0.0.1:%lu", port);
+		}
+	}
+
+	if (listen(fd, 16)) {
+		err(errno, "listen");
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Starts answering scrapes on `address`.
+ *
+ * @param address - The path of a Unix socket or a port on the loopback
+ * interface.
+ * @param index_bytes - The memory used by the index.
+ */
+void metrics_start(const char *address, size_t index_bytes) {
+	METRICS.index_bytes = index_bytes;
+	ENDPOINT.fd = endpoint_bind(address);
+
+	int check = pthread_create(&ENDPOINT.thread, NULL, endpoint_main, NULL);
+	if (check) {
+		errx(1, "Failed to start the metrics endpoint: %s", strerror(check));
+	}
+
+	ENDPOINT.started = 1;
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Serving metrics on %s\n", address);
+	}
+}
+
+/** @brief Records a served query. */
+void metrics_record(const metrics_query_t *query) {
+	pthread_mutex_lock(&METRICS.lock);
+
+	METRICS.requests++;
+	METRICS.invalid += query->status == SHM_INVALID;
+	METRICS.overflow += query->status == SHM_OVERFLOW;
+	METRICS.bases += query->bases;
+	METRICS.mums += query->mums;
+	METRICS.cache_hits += query->cache_hits;
+	METRICS.cache_misses += query->cache_misses;
+
+	histogram_add(&METRICS.match, query->match);
+	if (query->wait >= 0) histogram_add(&METRICS.wait, query->wait);
+
+	pthread_mutex_unlock(&METRICS.lock);
+}
+
+/** @brief Stops the endpoint and removes its socket. */
+void metrics_stop(void) {
+	if (!ENDPOINT.started) return;
+
+	// wakes up the blocked accept()
+	shutdown(ENDPOINT.fd, SHUT_RDWR);
+	pthread_join(ENDPOINT.thread, NULL);
+	close(ENDPOINT.fd);
+
+	if (ENDPOINT.path) unlink(ENDPOINT.path);
+	ENDPOINT.started = 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the metrics endpoint in
+ * metrics.c.
+ */
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdlib.h>
+
+/** @brief What is known about one served query. */
+typedef struct metrics_query_s {
+	/** The time from submission to the start of matching in seconds, or a
+	 * negative value if unknown. */
+	double wait;
+	/** The time spent matching in seconds. */
+	double match;
+	size_t bases, mums;
+	/** Lookups that could or could not start from a cached interval. */
+	size_t cache_hits, cache_misses;
+	int status;
+} metrics_query_t;
+
+void metrics_start(const char *address, size_t index_bytes);
+void metrics_record(const metrics_query_t *query);
+void metrics_stop(void);
+
+#endif // _METRICS_H_
@@ -4,16 +4,24 @@
  * @file
  * @brief This file contains various distance methods.
  */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include "delta.h"
+#include "dotplot.h"
 #include "esa.h"
 #include "global.h"
 #include "io.h"
 #include "process.h"
 #include "sequence.h"
+#include "shm.h"
+#include "store.h"
+#include "worker.h"
 
 #include <time.h>
 
@@ -46,6 +54,29 @@ size_t minAnchorLength(double p, double g, size_t l) {
 	return x;
 }
 
+/**
+ * @brief Calculates the minimum anchor length for proteins.
+ *
+ * This is minAnchorLength() for a random sequence over the 20 amino acids
+ * with equal frequencies. Then the probability that a shustring is at most
+ * `x` long simplifies to `(1 - 20^-x)^l`.
+ *
+ * @param p - The probability with which an anchor is allowed to be random.
+ * @param l - The length of the subject.
+ * @returns The minimum length of an anchor.
+ */
+size_t minProteinAnchorLength(double p, size_t l) {
+	size_t x = 1;
+
+	double prop = 0.0;
+	while (prop < 1 - p) {
+		prop = exp((double)l * log1p(-pow(20, -(double)x)));
+		x++;
+	}
+
+	return x;
+}
+
 /**
  * @brief Calculates the binomial coefficient of n and k.
  *
@@ -120,14 +151,271 @@ double shuprop(size_t x, double p, size_t l) {
 }
 
 /**
- * @param C - The enhanced suffix array of the subject.
+ * @brief Counters collected while scanning a single query.
+ *
+ * These are cheap to maintain and only reported if ::QUERY_STATS is set.
+ */
+typedef struct anchor_stats_s {
+	/** The number of MUMs printed. */
+	size_t mums;
+	/** The number of lookups in the ESA. */
+	size_t lookups;
+	/** The summed length of all looked up matches. */
+	size_t matched;
+	/** The number of lookups reused from the previous query. */
+	size_t reused;
+} anchor_stats_t;
+
+/** @brief Prints an anchor. With ::BRIDGE the mismatches are printed, too. */
+static void print_anchor(anchor_sink_t *sink, const anchor_t *anchor) {
+	FILE *out = sink->out;
+
+	if (BRIDGE) {
+		fprintf(out, "%8zu  %8zu  %8zu  %8zu\n", anchor->pos_S + 1,
+				anchor->pos_Q + 1, anchor->length, anchor->mismatches);
+		return;
+	}
+
+	fprintf(out, "%8zu  %8zu  %8zu\n", anchor->pos_S + 1, anchor->pos_Q + 1,
+			anchor->length);
+}
+
+/**
+ * @brief With ::TOP, keeps the longest anchors of one strand.
+ *
+ * The anchors form a min-heap, ordered by length and, among equal lengths,
+ * with the rightmost on top. Once the heap is full, its top is the length an
+ * anchor needs to get in; dist_anchor() skips shorter ones early.
+ */
+typedef struct top_sink_s {
+	anchor_sink_t base;
+	anchor_t *heap;
+	size_t size, capacity;
+} top_sink_t;
+
+/** @brief Returns 1 iff `a` is evicted before `b`. */
+static int top_less(const anchor_t *a, const anchor_t *b) {
+	return a->length < b->length ||
+		   (a->length == b->length && a->pos_Q > b->pos_Q);
+}
+
+/** @brief Restores the heap property below `k`. */
+static void top_sift_down(anchor_t *heap, size_t size, size_t k) {
+	for (;;) {
+		size_t min = k;
+		size_t left = 2 * k + 1, right = 2 * k + 2;
+
+		if (left < size && top_less(&heap[left], &heap[min])) min = left;
+		if (right < size && top_less(&heap[right], &heap[min])) min = right;
+		if (min == k) return;
+
+		anchor_t tmp = heap[k];
+		heap[k] = heap[min];
+		heap[min] = tmp;
+		k = min;
+	}
+}
+
+/** @brief Adds an anchor to the heap, evicting the least one if full. */
+static void top_push(anchor_sink_t *base, const anchor_t *anchor) {
+	top_sink_t *self = (top_sink_t *)base;
+	anchor_t *heap = self->heap;
+
+	if (self->size < TOP) {
+		if (self->size == self->capacity) {
+			self->capacity = self->capacity ? self->capacity * 2 : 64;
+			if (self->capacity > TOP) self->capacity = TOP;
+
+			heap = self->heap =
+				realloc(heap, self->capacity * sizeof(*heap));
+			CHECK_MALLOC(heap);
+		}
+
+		// sift up
+		size_t k = self->size++;
+		while (k > 0 && top_less(anchor, &heap[(k - 1) / 2])) {
+			heap[k] = heap[(k - 1) / 2];
+			k = (k - 1) / 2;
+		}
+		heap[k] = *anchor;
+	} else if (top_less(&heap[0], anchor)) {
+		heap[0] = *anchor;
+		top_sift_down(heap, self->size, 0);
+	}
+
+	if (self->size == TOP) {
+		base->min_length = heap[0].length;
+	}
+}
+
+static int top_compare(const void *a, const void *b) {
+	const anchor_t *x = a, *y = b;
+	return top_less(x, y) ? 1 : top_less(y, x) ? -1 : 0;
+}
+
+/** @brief Prints the kept anchors, longest first, and empties the heap. */
+static void top_flush(top_sink_t *self, FILE *out) {
+	qsort(self->heap, self->size, sizeof(*self->heap), top_compare);
+
+	anchor_sink_t printer = {.out = out};
+	for (size_t k = 0; k < self->size; k++) {
+		print_anchor(&printer, &self->heap[k]);
+	}
+
+	self->size = 0;
+	self->base.min_length = 0;
+}
+
+/** @brief With ::DOTPLOT, adds the anchors of one strand to the dot plot. */
+typedef struct dotplot_sink_s {
+	anchor_sink_t base;
+	const seq_t *query;
+	int reverse;
+} dotplot_sink_t;
+
+static void dotplot_push(anchor_sink_t *base, const anchor_t *anchor) {
+	dotplot_sink_t *self = (dotplot_sink_t *)base;
+	dotplot_add(self->query, anchor->pos_S, anchor->pos_Q, anchor->length,
+				self->reverse);
+}
+
+/**
+ * @brief Tries to merge a MUM into the current block.
+ *
+ * The MUM is merged if it lies on the same diagonal as the block, downstream
+ * of it, and the gap between both contains at most ::BRIDGE mismatches. The
+ * gap is compared character by character; no lookup is needed.
+ *
+ * @param S - The subject.
+ * @param query - The query.
+ * @param block - The current block. Has length zero if there is none.
+ * @param anchor - The new MUM.
+ * @returns 1 iff the MUM was merged into the block.
+ */
+static int bridge_anchor(const char *S, const char *query, anchor_t *block,
+						 const anchor_t *anchor) {
+	if (!block->length ||
+		block->pos_S + anchor->pos_Q != anchor->pos_S + block->pos_Q) {
+		return 0;
+	}
+
+	size_t end_Q = block->pos_Q + block->length;
+	if (anchor->pos_Q < end_Q) return 0;
+
+	size_t mismatches = 0;
+	for (size_t i = end_Q; i < anchor->pos_Q; i++) {
+		char c = S[block->pos_S + (i - block->pos_Q)];
+		if (c != query[i] && ++mismatches > (size_t)BRIDGE) {
+			return 0;
+		}
+	}
+
+	block->length = anchor->pos_Q + anchor->length - block->pos_Q;
+	block->mismatches += mismatches + anchor->mismatches;
+	return 1;
+}
+
+/**
+ * @brief Finds where the k-mers at the end of a query missing from the subject
+ * begin.
+ *
+ * Candidates of the Bloom filter are verified by a lookup, so false positives
+ * do not end the search early.
+ *
+ * @returns The first position from which on no k-mer of the query occurs in
+ * the subject.
+ */
+static size_t absent_suffix(const subject_t *I, const char *query,
+							size_t query_length) {
+	size_t k = I->bloom.k;
+	if (query_length < k) return 0;
+
+	size_t end = query_length - k + 1;
+	while ((end = bloom_present_before(&I->bloom, query, end))) {
+		size_t length;
+		if (FLAGS & F_RINDEX) {
+			size_t pos;
+			int unique;
+			length = rindex_match(&I->R, query + end - 1, k, &pos, &unique);
+		} else {
+			lcp_inter_t inter = get_match_cached(&I->E, query + end - 1, k);
+			length = inter.l <= 0 ? 0 : inter.l;
+		}
+
+		if (length == k) break;
+		end--;
+	}
+
+	return end;
+}
+
+/**
+ * @brief Corrects a lookup of a partial index shorter than its k-mers.
+ *
+ * Such a match over ACGT may continue, or occur elsewhere, in suffixes that
+ * are not indexed. Its length and uniqueness are taken from the counts of
+ * short strings instead. A unique match lies within a MUM iff the query,
+ * extended to the left to the minimum length, occurs in the subject. That
+ * extension starts with an indexed k-mer, and the lookup yields the position.
+ * Thus, the scan advances and finds MUMs exactly as with a full index.
+ *
+ * @param I - The subject and its partial index.
+ * @param query - The query string.
+ * @param query_length - The length of the query.
+ * @param pos_Q - The position of the lookup in the query.
+ * @param threshold - The minimum length of a MUM.
+ * @param length - (input/output parameter) The length of the match.
+ * @param pos_S - (output parameter) The position of a unique match.
+ * @returns 1 if the match is unique and can be extended to a MUM, 0 if not,
+ * and -1 if the lookup was exact already.
+ */
+static int partial_short_match(const subject_t *I, const char *query,
+							   size_t query_length, size_t pos_Q,
+							   size_t threshold, size_t *length,
+							   size_t *pos_S) {
+	const char *str = query + pos_Q;
+	size_t l = *length;
+	uint64_t code = 0;
+
+	for (size_t k = 0; k < l; k++) {
+		ssize_t c = char2code(str[k]);
+		if (c < 0) return -1;
+		code = code << 2 | c;
+	}
+
+	while (l + 1 < I->partial_k && pos_Q + l < query_length) {
+		ssize_t c = char2code(str[l]);
+		if (c < 0 || !counts_get(&I->counts, code << 2 | c, l + 1)) break;
+		code = code << 2 | c;
+		l++;
+	}
+
+	*length = l;
+	if (!l || counts_get(&I->counts, code, l) != 1) return 0;
+
+	size_t extension = threshold - l;
+	if (pos_Q < extension) return 0;
+
+	lcp_inter_t check = get_match_cached(&I->E, str - extension, threshold);
+	if ((size_t)check.l < threshold) return 0;
+
+	*pos_S = I->E.SA[check.i] + extension;
+	return 1;
+}
+
+/**
+ * @param I - The subject and its index.
  * @param query - The actual query string.
  * @param query_length - The length of the query string. Needed for speed
  * reasons.
- * @param gc - The gc-content of the subject.
+ * @param sink - Receives the MUMs.
+ * @param delta - The state for reusing lookups of the previous query, or NULL.
+ * @param stats - (output parameter) Counters for this query.
  */
-void dist_anchor(const esa_s *C, const char *query, size_t query_length,
-				 double gc) {
+void dist_anchor(const subject_t *I, const char *query, size_t query_length,
+				 anchor_sink_t *sink, delta_t *delta, anchor_stats_t *stats) {
+	const esa_s *C = &I->E;
+	const char *S = FLAGS & F_RINDEX ? I->R.S : C->S;
 	lcp_inter_t inter;
 
 	size_t last_pos_Q = 0;
@@ -143,84 +431,688 @@ void dist_anchor(const esa_s *C, const char *query, size_t query_length,
 
 	size_t num_right_anchors = 0;
 
-	size_t threshold;
-	if (MIN_LENGTH != 0) {
-		threshold = MIN_LENGTH;
-	} else {
-		threshold = minAnchorLength(RANDOM_ANCHOR_PROP, gc, C->len);
+	size_t threshold = I->threshold;
+
+	/* With F_BLOOM, the scan ends at `stop`. No k-mer starting at or after
+	 * `stop - k` occurs in the subject. As a MUM consists of k-mers of the
+	 * subject, it ends before `stop`, and no lookup from `stop` on can find
+	 * one. Nothing follows, so the MUMs are the same as without the filter.
+	 * Within the query, a region without subject k-mers cannot be skipped
+	 * like this: the scan would resume at a different position. */
+	size_t stop = query_length;
+	if (FLAGS & F_BLOOM) {
+		stop = absent_suffix(I, query, query_length) + I->bloom.k;
+		if (stop > query_length) stop = query_length;
 	}
 
+	// With ::BRIDGE, the MUMs merged so far; printed once a MUM cannot join.
+	anchor_t block = {.length = 0};
+
 	// Iterate over the complete query.
-	while (this_pos_Q < query_length) {
-		inter =
-			get_match_cached(C, query + this_pos_Q, query_length - this_pos_Q);
+	while (this_pos_Q < stop) {
+		if (!BRIDGE && sink->min_length > threshold) {
+			threshold = sink->min_length;
+		}
+
+		int reused = 0, unique;
+		if (FLAGS & F_RINDEX) {
+			this_length = rindex_match(&I->R, query + this_pos_Q,
+									   query_length - this_pos_Q, &this_pos_S,
+									   &unique);
+		} else {
+			if (delta) {
+				inter = delta_lookup(delta, C, query, query_length, this_pos_Q,
+									 &reused);
+			} else {
+				inter = get_match_cached(C, query + this_pos_Q,
+										 query_length - this_pos_Q);
+			}
 
-		this_length = inter.l <= 0 ? 0 : inter.l;
+			this_length = inter.l <= 0 ? 0 : inter.l;
+			this_pos_S = C->SA[inter.i];
+			unique = inter.i == inter.j;
+		}
+
+		if (I->partial_k && this_length < I->partial_k) {
+			int check = partial_short_match(I, query, query_length, this_pos_Q,
+											threshold, &this_length,
+											&this_pos_S);
+			if (check >= 0) unique = check;
+		}
 
-		this_pos_S = C->SA[inter.i];
-		while (this_pos_Q > 0 &&
-			   query[this_pos_Q - 1] == C->S[this_pos_S - 1]) {
+		if (reused) {
+			stats->reused++;
+		} else {
+			stats->lookups++;
+			stats->matched += this_length;
+		}
+
+		if (!S) {
+			// Without the text, only a unique match is worth extending.
+			size_t e = unique ? rindex_extend_left(&I->R, query, this_pos_Q,
+												   this_length)
+							  : 0;
+			this_pos_S -= e;
+			this_pos_Q -= e;
+			this_length += e;
+		}
+
+		while (S && this_pos_Q > 0 &&
+			   query[this_pos_Q - 1] == S[this_pos_S - 1]) {
 			this_pos_S--;
 			this_pos_Q--;
 			this_length++;
 		}
 
-		if (inter.i == inter.j && this_length >= threshold) {
-			printf("%8zu  %8zu  %8zu\n", this_pos_S + 1, this_pos_Q + 1,
-				   this_length);
+		if (unique && this_length >= threshold) {
+			anchor_t anchor = {this_pos_S, this_pos_Q, this_length, 0};
+
+			if (!BRIDGE) {
+				sink->push(sink, &anchor);
+				stats->mums++;
+			} else if (!bridge_anchor(S, query, &block, &anchor)) {
+				if (block.length) {
+					sink->push(sink, &block);
+					stats->mums++;
+				}
+				block = anchor;
+			}
 		}
 
 		// Advance
 		this_pos_Q += this_length + 1;
 	}
 
+	if (block.length) {
+		sink->push(sink, &block);
+		stats->mums++;
+	}
+
 	// Very special case: The sequences are identical
 	if (last_length >= query_length) {
-		printf("%zu %zu %zu\n", last_pos_S, (size_t)0, query_length);
+		anchor_t anchor = {last_pos_S, 0, query_length, 0};
+		sink->push(sink, &anchor);
 	}
 }
 
 /**
- * @param sequences - An array of pointers to the sequences.
- * @param n - The number of sequences.
+ * @brief Finds the MUMs of one strand of a query.
+ *
+ * Unlike compare_query(), this neither prints headers nor records
+ * statistics; the MUMs are just passed to `sink`.
+ *
+ * @param I - The subject and its index.
+ * @param query - The query string.
+ * @param query_length - The length of the query.
+ * @param sink - Receives the MUMs.
  */
-void run(seq_t *sequences, size_t n) {
-	seq_t *subject = &sequences[0];
-	esa_s E;
+void query_anchors(const subject_t *I, const char *query, size_t query_length,
+				   anchor_sink_t *sink) {
+	anchor_stats_t stats = {};
+	dist_anchor(I, query, query_length, sink, NULL, &stats);
+}
 
-	if (seq_subject_init(subject) || esa_init(&E, subject)) {
-		errx(1, "Failed to create index for %s.", subject->name);
+/** @brief Writes `value` as a LEB128 varint: seven bits per byte, least
+ * significant group first, the high bit marking continuation. */
+static void write_varint(FILE *out, uint64_t value) {
+	while (value >= 0x80) {
+		putc((value & 0x7f) | 0x80, out);
+		value >>= 7;
 	}
+	putc(value, out);
+}
 
-	size_t i = 0;
-	// now compare every other sequence to the subject
-	for (size_t j = 0; j < n; j++) {
-		if (j == i) {
-			continue;
+/**
+ * @brief Computes the matching statistics of a query.
+ *
+ * `MS[p]` is the length of the longest prefix of `query[p..]` occurring in
+ * the subject. As `MS[p+1] >= MS[p] - 1`, each lookup starts from the
+ * interval of the first `MS[p] - 1` characters, found by a suffix link from
+ * the previous one, see get_match_next(). The values are written as
+ * the varints `MS[0]` and `MS[p+1] - MS[p] + 1` for all following positions,
+ * which mostly fit into a single byte.
+ *
+ * @param I - The subject and its index.
+ * @param query - The query string.
+ * @param query_length - The length of the query.
+ * @param out - The stream to write the matching statistics to.
+ * @param stats - (output parameter) Counters for this query.
+ */
+static void matching_stats(const subject_t *I, const char *query,
+						   size_t query_length, FILE *out,
+						   anchor_stats_t *stats) {
+	const esa_s *C = &I->E;
+	size_t last = 0;
+	lcp_inter_t inter = {.l = 0};
+
+	write_varint(out, query_length);
+
+	for (size_t p = 0; p < query_length; p++) {
+		inter = get_match_next(C, query + p, query_length - p, inter);
+		size_t length = inter.l <= 0 ? 0 : inter.l;
+
+		write_varint(out, p ? length - last + 1 : length);
+
+		stats->lookups++;
+		stats->matched += length;
+		last = length;
+	}
+}
+
+/**
+ * @brief With F_DELTA, the lookups of the previous query per strand; forward
+ * first. Every worker process keeps its own.
+ */
+static delta_t DELTA[2];
+
+/** @brief Returns the wall time in seconds. */
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Scans one strand of a query and reports its counters.
+ *
+ * If `stats_file` is set, a tab separated record with the query name, strand,
+ * length, the number of MUMs and lookups, the average match length per lookup,
+ * the wall time, the throughput and the worker is written to it.
+ *
+ * @param I - The subject and its index.
+ * @param seq - The query.
+ * @param strand - Either "+" or "-".
+ * @param query - The query string of the strand.
+ * @param ql - The length of the query.
+ * @param skip - Iff set, the query is known to contain no MUM.
+ * @param out - The stream to print MUMs to.
+ * @param stats_file - The stream for the performance record, or NULL.
+ * @param worker - The number of the worker process, or 0 for the main process.
+ */
+static void scan_query(const subject_t *I, const seq_t *seq,
+					   const char *strand, const char *query, size_t ql,
+					   int skip, FILE *out, FILE *stats_file, int worker) {
+	const char *name = seq->name;
+	anchor_stats_t stats = {};
+	anchor_sink_t printer = {.push = print_anchor, .out = out};
+	top_sink_t top = {.base = {.push = top_push}};
+	dotplot_sink_t plot = {.base = {.push = dotplot_push},
+						   .query = seq,
+						   .reverse = *strand == '-'};
+
+	anchor_sink_t *sink = &printer;
+	if (TOP) sink = &top.base;
+	if (DOTPLOT) sink = &plot.base;
+	double start = wall_time();
+
+	if (MATCHING_STATS) {
+		matching_stats(I, query, ql, out, &stats);
+	} else if (!skip && FLAGS & F_DELTA) {
+		delta_t *delta = &DELTA[*strand == '-'];
+
+		delta_begin(delta, query, ql);
+		dist_anchor(I, query, ql, sink, delta, &stats);
+		delta_end(delta);
+
+		if (FLAGS & F_VERBOSE) {
+			fprintf(stderr, "%s (%s): reused %zu of %zu lookups\n", name,
+					strand, stats.reused, stats.reused + stats.lookups);
 		}
+	} else if (!skip) {
+		dist_anchor(I, query, ql, sink, NULL, &stats);
+	}
+
+	if (TOP) {
+		stats.mums = top.size;
+		top_flush(&top, out);
+		free(top.heap);
+	}
+
+	if (!stats_file) return;
+
+	double secs = wall_time() - start;
 
-		// TODO: Provide a nicer progress indicator.
-		if (FLAGS & F_EXTRA_VERBOSE) {
 #pragma omp critical
-			{ fprintf(stderr, "comparing %zu and %zu\n", i, j); }
+	{
+		fprintf(stats_file, "%s\t%s\t%zu\t%zu\t%zu\t%.2f\t%.6f\t%.0f\t%d\n",
+				name, strand, ql, stats.mums, stats.lookups,
+				stats.lookups ? (double)stats.matched / stats.lookups : 0.0,
+				secs, secs > 0 ? ql / secs : 0.0, worker);
+	}
+}
+
+/**
+ * @brief Checks the sketches of subject and query for shared minimizers.
+ *
+ * @returns 1 iff the pair cannot contain a MUM and may be skipped.
+ */
+static int prefilter(const subject_t *I, const seq_t *query) {
+	sketch_t sketch;
+	if (sketch_init(&sketch, query->S, query->len, I->sketch_k,
+					I->sketch_w)) {
+		return 0;
+	}
+
+	size_t shared = sketch_shared(&I->sketch, &sketch);
+	int skip = shared < SKETCH_CUTOFF;
+
+	if (FLAGS & F_VERBOSE) {
+#pragma omp critical
+		{
+			fprintf(stderr,
+					"%s: %zu of %zu minimizers shared (containment %.4f)%s\n",
+					query->name, shared, sketch.size,
+					sketch.size ? (double)shared / sketch.size : 0.0,
+					skip ? "; skipped" : "");
 		}
+	}
+
+	sketch_free(&sketch);
+	return skip;
+}
+
+/**
+ * @brief Starts the output for one strand of a query.
+ *
+ * In matching statistics mode a record starts with the NUL terminated name and
+ * the strand character, followed by the varints from matching_stats().
+ */
+static void print_header(FILE *out, const char *name, char strand) {
+	if (MATCHING_STATS) {
+		fputs(name, out);
+		putc('\0', out);
+		putc(strand, out);
+		return;
+	}
+
+	fprintf(out, "> %s%s\n", name, strand == '-' ? " Reverse" : "");
+}
 
-		size_t ql = sequences[j].len;
+/**
+ * @brief Compares a single query against the subject.
+ *
+ * Depending on the set flags, the forward strand, the reverse complement or
+ * both are scanned for MUMs.
+ *
+ * @param I - The subject and its index.
+ * @param query - The query.
+ * @param out - The stream to print MUMs to.
+ * @param stats_file - The stream for performance records, or NULL.
+ * @param worker - The number of the worker process, or 0 for the main process.
+ */
+void compare_query(const subject_t *I, const seq_t *query, FILE *out,
+				   FILE *stats_file, int worker) {
+	size_t ql = query->len;
+	int skip = FLAGS & F_SKETCH && !MATCHING_STATS ? prefilter(I, query) : 0;
+
+	if (FLAGS & F_FORWARD) {
+		if (!DOTPLOT) print_header(out, query->name, '+');
+		scan_query(I, query, "+", query->S, ql, skip, out, stats_file,
+				   worker);
+	}
+
+	if (FLAGS & F_REVCOMP) {
+		char *R = revcomp(query->S, ql);
+
+		if (!DOTPLOT) print_header(out, query->name, '-');
+		scan_query(I, query, "-", R, ql, skip, out, stats_file, worker);
+		free(R);
+	}
+}
 
-		if (FLAGS & F_FORWARD) {
-			printf("> %s\n", sequences[j].name);
-			dist_anchor(&E, sequences[j].S, ql, subject->gc);
+/**
+ * @brief Opens the output file of a query in ::OUTPUT_DIR.
+ *
+ * The file is named after the index of the query, as sequence names may
+ * contain arbitrary characters. With ::OUTPUT_FILES, the file given in the
+ * manifest is opened for appending instead.
+ *
+ * @param j - The index of the query.
+ * @param mode - The mode as for fopen(); ignored with ::OUTPUT_FILES.
+ * @returns The opened file. Exits on failure.
+ */
+FILE *query_output(size_t j, const char *mode) {
+	if (OUTPUT_FILES) {
+		// shared by all sequences of a query file and truncated up front
+		FILE *file = fopen(OUTPUT_FILES[j], "a");
+		if (!file) {
+			err(errno, "%s", OUTPUT_FILES[j]);
 		}
+		return file;
+	}
 
-		if (FLAGS & F_REVCOMP) {
-			char *R = revcomp(sequences[j].S, ql);
+	char *path = NULL;
+	if (asprintf(&path, "%s/%zu.out", OUTPUT_DIR, j) < 0) {
+		err(errno, "asprintf");
+	}
+
+	FILE *file = fopen(path, mode);
+	if (!file) {
+		err(errno, "%s", path);
+	}
 
-			printf("> %s Reverse\n", sequences[j].name);
-			dist_anchor(&E, R, ql, subject->gc);
-			free(R);
+	free(path);
+	return file;
+}
+
+/**
+ * @brief Writes the manifest of ::OUTPUT_DIR.
+ *
+ * The manifest lists the index, name, output file and size of every query in
+ * the order of the input. Concatenating the files in this order yields the
+ * output of a run without `--output-dir`.
+ */
+static void write_manifest(const seq_t *sequences, size_t n) {
+	char *path = NULL;
+	if (asprintf(&path, "%s/manifest.tsv", OUTPUT_DIR) < 0) {
+		err(errno, "asprintf");
+	}
+
+	FILE *manifest = fopen(path, "w");
+	if (!manifest) {
+		err(errno, "%s", path);
+	}
+
+	fprintf(manifest, "index\tname\tfile\tbytes\n");
+	for (size_t j = 1; j < n; j++) {
+		FILE *file = query_output(j, "r");
+		fseek(file, 0, SEEK_END);
+		long bytes = ftell(file);
+		fclose(file);
+
+		fprintf(manifest, "%zu\t%s\t%zu.out\t%ld\n", j, sequences[j].name, j,
+				bytes);
+	}
+
+	fclose(manifest);
+	free(path);
+}
+
+/**
+ * @brief Collects the k-mers of all queries.
+ *
+ * If the reverse complement is to be matched as well, its k-mers are included.
+ *
+ * @param queries - The queries.
+ * @param n - The number of queries.
+ * @param k - The k-mer length.
+ * @returns A bit set of 4^k bits with bit x set iff the k-mer with code x
+ * occurs. The caller has to free it.
+ */
+static uint64_t *query_kmers(const seq_t *queries, size_t n, size_t k) {
+	size_t words = ((1ULL << (2 * k)) + 63) / 64;
+	uint64_t *kmers = calloc(words, sizeof(*kmers));
+	CHECK_MALLOC(kmers);
+
+	const uint64_t mask = (1ULL << (2 * k)) - 1;
+	const size_t shift = 2 * (k - 1);
+
+	for (size_t j = 0; j < n; j++) {
+		const char *S = queries[j].S;
+		uint64_t fw = 0, rc = 0;
+		size_t valid = 0;
+
+		for (size_t i = 0; i < queries[j].len; i++) {
+			ssize_t code = char2code(S[i]);
+			if (code < 0) {
+				valid = 0;
+				continue;
+			}
+
+			fw = ((fw << 2) | code) & mask;
+			rc = (rc >> 2) | ((uint64_t)(3 - code) << shift);
+			if (++valid < k) continue;
+
+			if (FLAGS & F_FORWARD) {
+				kmers[fw >> 6] |= 1ULL << (fw & 63);
+			}
+			if (FLAGS & F_REVCOMP) {
+				kmers[rc >> 6] |= 1ULL << (rc & 63);
+			}
 		}
 	}
 
-	esa_free(&E);
-	seq_subject_free(subject);
+	return kmers;
+}
+
+/**
+ * @brief Builds the index and everything else needed for a subject.
+ *
+ * With F_PARTIAL, only suffixes starting with a k-mer of a query are indexed.
+ * With F_DROP_TEXT, the text of the subject is freed once it is indexed.
+ *
+ * @param I - The subject to initialize.
+ * @param subject - The subject sequence.
+ * @param queries - The queries; only needed with F_PARTIAL.
+ * @param num_queries - The number of queries.
+ * @returns 0 iff successful
+ */
+int subject_init(subject_t *I, seq_t *subject, const seq_t *queries,
+				 size_t num_queries) {
+	*I = (subject_t){.seq = subject};
+
+	if (seq_subject_init(subject)) {
+		return 1;
+	}
+
+	if (MIN_LENGTH != 0) {
+		I->threshold = MIN_LENGTH;
+	} else if (FLAGS & F_PROTEIN) {
+		I->threshold = minProteinAnchorLength(RANDOM_ANCHOR_PROP, subject->len);
+	} else {
+		I->threshold =
+			minAnchorLength(RANDOM_ANCHOR_PROP, subject->gc, subject->len);
+	}
+
+	if (FLAGS & F_PARTIAL) {
+		size_t k = I->threshold < PARTIAL_K ? I->threshold : PARTIAL_K;
+		I->partial_k = k ? k : 1;
+
+		uint64_t *kmers = query_kmers(queries, num_queries, I->partial_k);
+		int check = esa_init_partial(&I->E, subject, kmers, I->partial_k);
+		free(kmers);
+
+		if (check ||
+			counts_init(&I->counts, subject->RS, subject->RSlen,
+						I->partial_k - 1)) {
+			return 1;
+		}
+
+		if (FLAGS & F_VERBOSE) {
+			fprintf(stderr, "Partial index: %zu of %zu suffixes (k = %zu)\n",
+					(size_t)I->E.len, subject->len, I->partial_k);
+		}
+	} else if (FLAGS & F_RINDEX) {
+		if (rindex_init(&I->R, subject)) return 1;
+	} else if (!INDEX_CACHE || store_load(&I->E, subject)) {
+		if (esa_init(&I->E, subject)) return 1;
+		if (INDEX_CACHE) store_save(&I->E, subject);
+	}
+
+	if (MATCHING_STATS && FLAGS & F_PARTIAL) {
+		errx(1, "Matching statistics require a full index; they cannot be "
+				"computed with --partial-index.");
+	}
+
+	if (MATCHING_STATS && esa_init_links(&I->E)) return 1;
+
+	if (SUS_FILE) {
+		if (FLAGS & F_PARTIAL) {
+			errx(1, "The SUS array requires a full index; it cannot be "
+					"combined with --partial-index.");
+		}
+
+		if (esa_init_SUS(&I->E)) return 1;
+
+		for (size_t p = 0; p < (size_t)I->E.len; p++) {
+			fprintf(SUS_FILE, "%d\n", (int)I->E.SUS[p]);
+		}
+		fflush(SUS_FILE);
+
+		// Nothing else uses the array.
+		free(I->E.SUS);
+		I->E.SUS = NULL;
+	}
+
+	if (FLAGS & F_BLOOM) {
+		size_t k = I->threshold < BLOOM_MAX_K ? I->threshold : BLOOM_MAX_K;
+		if (bloom_init(&I->bloom, subject->S, subject->len, k ? k : 1)) {
+			return 1;
+		}
+	}
+
+	if (FLAGS & F_SKETCH) {
+		sketch_params(I->threshold, &I->sketch_k, &I->sketch_w);
+		if (sketch_init(&I->sketch, subject->S, subject->len, I->sketch_k,
+						I->sketch_w)) {
+			return 1;
+		}
+
+		if (FLAGS & F_VERBOSE) {
+			fprintf(stderr,
+					"Sketch prefilter: k = %zu, w = %zu, %zu minimizers; "
+					"skipping queries with fewer than %d shared minimizers\n",
+					I->sketch_k, I->sketch_w, I->sketch.size, SKETCH_CUTOFF);
+		}
+	}
+
+	// Nothing reads the text from here on; see rindex_match().
+	if (FLAGS & F_DROP_TEXT) {
+		free(subject->S);
+		subject->S = NULL;
+		I->R.S = NULL;
+	}
+
+	if (FLAGS & F_RINDEX && FLAGS & F_VERBOSE) {
+		fprintf(stderr, "r-index: %zu runs for %zu suffixes, %zu bytes\n",
+				rindex_runs(&I->R), (size_t)I->R.len, rindex_bytes(&I->R));
+	}
+
+	return 0;
+}
+
+/** @brief Frees a subject and its index. */
+void subject_free(subject_t *I) {
+	esa_free(&I->E);
+	rindex_free(&I->R);
+	bloom_free(&I->bloom);
+	counts_free(&I->counts);
+	sketch_free(&I->sketch);
+	seq_subject_free((seq_t *)I->seq);
+	*I = (subject_t){};
+}
+
+/** @brief The index of the subject built in the background. */
+static struct {
+	pthread_t thread;
+	int started;
+	/** A copy of the subject, as the array of sequences may still move. */
+	seq_t seq;
+	subject_t I;
+	/** The return value of subject_init(). */
+	int check;
+} BUILD;
+
+static void *build_subject(void *unused) {
+	(void)unused;
+	BUILD.check = subject_init(&BUILD.I, &BUILD.seq, NULL, 0);
+	return NULL;
+}
+
+/**
+ * @brief Starts building the index as soon as the subject has been read.
+ *
+ * This is a hook for read_fasta(). Once the first sequence is read, the index
+ * is built on a background thread while the queries are parsed. A partial
+ * index depends on the queries and thus is built by run().
+ *
+ * @param dsa - The sequences read so far.
+ */
+void prepare_subject(dsa_t *dsa) {
+	if (BUILD.started || dsa_size(dsa) != 1 || FLAGS & F_PARTIAL) return;
+
+	// main() rejects empty and overlong subjects once all files are read.
+	const seq_t *subject = dsa_data(dsa);
+	const size_t LENGTH_LIMIT = (INT_MAX - 1) / 2;
+	if (subject->len == 0 ||
+		(!(FLAGS & F_RINDEX) && subject->len > LENGTH_LIMIT)) {
+		return;
+	}
+
+	BUILD.seq = *subject;
+
+	int check = pthread_create(&BUILD.thread, NULL, build_subject, NULL);
+	if (check) {
+		warnx("Failed to start building the index early: %s", strerror(check));
+		return;
+	}
+
+	BUILD.started = 1;
+}
+
+/**
+ * @param sequences - An array of pointers to the sequences.
+ * @param n - The number of sequences.
+ */
+void run(seq_t *sequences, size_t n) {
+	subject_t I;
+	int check;
+
+	if (BUILD.started) {
+		pthread_join(BUILD.thread, NULL);
+		I = BUILD.I;
+		check = BUILD.check;
+		// subject_init() may have dropped the text of the copy.
+		sequences[0].S = BUILD.seq.S;
+	} else {
+		check = subject_init(&I, &sequences[0], sequences + 1, n - 1);
+	}
+
+	if (check) {
+		errx(1, "Failed to create index for %s.", sequences[0].name);
+	}
+
+	if (QUERY_STATS) {
+		fprintf(QUERY_STATS, "name\tstrand\tlength\tmums\tlookups\tavg_match\t"
+							 "seconds\tbases_per_second\tworker\n");
+	}
+
+	FILE *out = MATCHING_STATS ? MATCHING_STATS : stdout;
+
+	if (DOTPLOT) {
+		dotplot_begin(sequences, n, WORKERS > 0);
+	}
+
+	if (SHM_NAME) {
+		shm_serve(&I, SHM_NAME);
+	} else if (WORKERS > 0) {
+		run_workers(&I, sequences, n, out);
+	} else {
+		// now compare every other sequence to the subject
+		for (size_t j = 1; j < n; j++) {
+			// TODO: Provide a nicer progress indicator.
+			if (FLAGS & F_EXTRA_VERBOSE) {
+#pragma omp critical
+				{ fprintf(stderr, "comparing %zu and %zu\n", (size_t)0, j); }
+			}
+
+			int own_file = OUTPUT_DIR || OUTPUT_FILES;
+			FILE *query_out = own_file ? query_output(j, "w") : out;
+			compare_query(&I, &sequences[j], query_out, QUERY_STATS, 0);
+			if (own_file) fclose(query_out);
+		}
+	}
+
+	if (OUTPUT_DIR) {
+		write_manifest(sequences, n);
+	}
+
+	if (DOTPLOT) {
+		dotplot_write(DOTPLOT);
+		dotplot_end();
+	}
+
+	delta_free(&DELTA[0]);
+	delta_free(&DELTA[1]);
+	subject_free(&I);
 }
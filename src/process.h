@@ -6,8 +6,81 @@
 #ifndef _PROCESS_H_
 #define _PROCESS_H_
 
+#include <stdio.h>
+#include "bloom.h"
+#include "counts.h"
+#include "esa.h"
+#include "rindex.h"
 #include "sequence.h"
+#include "sketch.h"
 
+/**
+ * @brief The minimum number of shared minimizers for a query to be compared
+ * when the sketch prefilter is active. Every MUM yields at least one.
+ */
+#define SKETCH_CUTOFF 1
+
+/** @brief The maximum k-mer length used to select suffixes for a partial
+ * index. The set of query k-mers takes 4^k bits. */
+#define PARTIAL_K 14
+
+/**
+ * @brief A subject and everything precomputed for it.
+ */
+typedef struct subject_s {
+	/** The subject sequence. */
+	const seq_t *seq;
+	/** The enhanced suffix array of the subject; unset with F_RINDEX. */
+	esa_s E;
+	/** The run-length compressed index; only set with F_RINDEX. */
+	rindex_t R;
+	/** The minimum length of a MUM. */
+	size_t threshold;
+	/** A Bloom filter of the subjects k-mers; only set with F_BLOOM. */
+	bloom_t bloom;
+	/** The sketch of the subject; only set with F_SKETCH. */
+	sketch_t sketch;
+	/** The parameters used for sketching. */
+	size_t sketch_k, sketch_w;
+	/** The k-mer length of a partial index, or 0 for a full index. */
+	size_t partial_k;
+	/** The counts of all strings shorter than `partial_k`; only set with
+		F_PARTIAL. */
+	counts_t counts;
+} subject_t;
+
+/** @brief An anchor; with ::BRIDGE possibly a block of several MUMs. */
+typedef struct anchor_s {
+	size_t pos_S, pos_Q, length;
+	/** The number of mismatches within the anchor. */
+	size_t mismatches;
+} anchor_t;
+
+/**
+ * @brief Receives the anchors of a query.
+ *
+ * Sinks needing more state embed this as their first member.
+ */
+typedef struct anchor_sink_s {
+	/** Called for every anchor in the order of the query. */
+	void (*push)(struct anchor_sink_s *self, const anchor_t *anchor);
+	/** The stream to print anchors to; unused by other sinks. */
+	FILE *out;
+	/** Shorter anchors are not wanted. A sink may raise this while anchors
+	 * arrive, see ::TOP. Ignored with ::BRIDGE, as short MUMs may still join
+	 * a long block. */
+	size_t min_length;
+} anchor_sink_t;
+
+int subject_init(subject_t *I, seq_t *subject, const seq_t *queries,
+				 size_t num_queries);
+void subject_free(subject_t *I);
+void prepare_subject(dsa_t *dsa);
 void run(seq_t *sequences, size_t n);
+FILE *query_output(size_t j, const char *mode);
+void query_anchors(const subject_t *I, const char *query, size_t query_length,
+				   anchor_sink_t *sink);
+void compare_query(const subject_t *I, const seq_t *query, FILE *out,
+				   FILE *stats_file, int worker);
 
 #endif
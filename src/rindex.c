@@ -0,0 +1,1034 @@
+/**
+ * @file
+ * @brief A run-length compressed index
+ *
+ * With `--r-index`, the subject is indexed by a run-length compressed BWT
+ * instead of an ESA, as in the r-index of Gagie, Navarro and Prezza (2018).
+ * A collection of similar genomes yields few runs, so the index stays small
+ * where the ESA grows with every genome added. Positions take 64 bits, so the
+ * subject is not limited in length as it is for the ESA.
+ *
+ * The BWT is built over the reversed text. A backward search then consumes
+ * the query from left to right, and the longest prefix of the query occurring
+ * in the text is found as with get_match(). The suffix array is only sampled
+ * at the last row of every run. That suffices to know one occurrence of the
+ * current match at every step (the toehold): if the BWT at the last row of
+ * the range holds the next character, the occurrence moves by one; otherwise
+ * the last occurrence of the character in the range ends a run and its
+ * sample is taken.
+ *
+ * Once the range shrinks to a single row, the match is unique and is
+ * extended against the text. With ::F_DROP_TEXT the text is not kept, and the
+ * search simply continues. As for the ESA, the search states of all prefixes
+ * of a fixed length are cached. The cache has the same number of entries as
+ * the LCP-interval cache, independent of the subject.
+ *
+ * The index is built by prefix-free parsing, as by Boucher et al. (2019),
+ * without a suffix array of the text. The text is cut into phrases after
+ * every window of ::PFP_WINDOW characters with a hash divisible by
+ * ::PFP_MODULUS; consecutive phrases overlap by that window. Similar genomes
+ * consist of the same phrases, so the dictionary of distinct phrases and the
+ * parse, the sequence of phrases of the text, are much smaller than the text.
+ * A suffix of the text is determined by its remainder within its phrase and
+ * the suffix of the parse after the phrase. The former are sorted by the
+ * suffix array of the dictionary and the latter by that of the parse. Thus,
+ * the runs are written in order without ever sorting the text.
+ */
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "hash.h"
+#include "rindex.h"
+
+/** @brief The number of characters of the windows ending phrases. */
+#define PFP_WINDOW 10
+
+/** @brief A window ends a phrase iff its hash is divisible by this; about
+ * the mean length of a phrase. */
+#define PFP_MODULUS 100
+
+/** @brief Ends every phrase in the dictionary. */
+#define END_OF_PHRASE 1
+
+/** @brief Stands for the sentinel in the dictionary, before all characters
+ * of the text. */
+#define DOLLAR 2
+
+/**
+ * @brief The prefix-free parse of the reversed text.
+ *
+ * The parse is cyclic: the text is followed by ::PFP_WINDOW dollars, which
+ * form a window ending a phrase. So the first phrase starts with them and the
+ * last one ends with them.
+ */
+typedef struct pfp_s {
+	/** The distinct phrases, each followed by ::END_OF_PHRASE. */
+	char *dict;
+	size_t dict_len, dict_capacity;
+	/** Phrase `d` starts at `dict[start[d]]`; `start[num_phrases]` is the
+		length of the dictionary. */
+	size_t *start;
+	/** The hash of every phrase. */
+	uint64_t *hash;
+	/** The number of occurrences of every phrase in the parse. */
+	uint32_t *freq;
+	size_t num_phrases, phrase_capacity;
+	/** An open addressing table of the phrases, plus one. */
+	uint32_t *table;
+	size_t table_size;
+	/** The parse; phrase numbers at first and ranks once sorted. */
+	uint32_t *P;
+	/** The position of every phrase of the parse in the text, plus
+		::PFP_WINDOW; the first phrase starts with the dollars. */
+	uint64_t *pos;
+	size_t length, capacity;
+	/** Bit `q` is set iff a phrase starts at `dict[q]`. */
+	uint64_t *starts;
+	/** The number of bits set before every word of `starts`. */
+	size_t *starts_rank;
+	/** The rank of every phrase and the phrase of every rank. */
+	uint32_t *rank, *phrase;
+	/** The suffix array of the parse. */
+	uint32_t *SA;
+	/** The rows `j` of `SA` whose phrase before `SA[j]` has the rank `r` are
+		`rows[rows_start[r]]` to `rows[rows_start[r + 1] - 1]`. */
+	uint32_t *rows, *rows_start;
+	/** The length of the text. */
+	uint64_t len;
+} pfp_t;
+
+/**
+ * @brief Adds a phrase to the parse, and to the dictionary if it is new.
+ *
+ * @param self - The parse.
+ * @param phrase - The characters of the phrase.
+ * @param length - The length of the phrase.
+ * @param pos - The position of the phrase in the text plus ::PFP_WINDOW.
+ * @returns 0 iff successful.
+ */
+static int pfp_add(pfp_t *self, const char *phrase, size_t length,
+				   uint64_t pos) {
+	uint64_t hash = 0;
+	for (size_t k = 0; k < length; k++) {
+		hash = hash * 0x100000001b3ULL + (unsigned char)phrase[k];
+	}
+	hash = mix64(hash);
+
+	size_t mask = self->table_size - 1;
+	size_t slot = hash & mask, d = 0;
+	for (; self->table[slot]; slot = (slot + 1) & mask) {
+		d = self->table[slot] - 1;
+		if (self->hash[d] == hash &&
+			self->start[d + 1] - self->start[d] - 1 == length &&
+			memcmp(self->dict + self->start[d], phrase, length) == 0) {
+			break;
+		}
+	}
+
+	if (!self->table[slot]) {
+		d = self->num_phrases;
+		if (d + 1 >= UINT32_MAX) return 1;
+
+		if (d + 1 >= self->phrase_capacity) {
+			self->phrase_capacity *= 2;
+			self->start = realloc(self->start,
+								  self->phrase_capacity * sizeof(*self->start));
+			self->hash = realloc(self->hash,
+								 self->phrase_capacity * sizeof(*self->hash));
+			self->freq = realloc(self->freq,
+								 self->phrase_capacity * sizeof(*self->freq));
+			CHECK_MALLOC(self->start);
+			CHECK_MALLOC(self->hash);
+			CHECK_MALLOC(self->freq);
+		}
+
+		// Keep room for a NUL after the dictionary.
+		while (self->dict_len + length + 2 > self->dict_capacity) {
+			self->dict_capacity *= 2;
+			self->dict = realloc(self->dict, self->dict_capacity);
+			CHECK_MALLOC(self->dict);
+		}
+
+		memcpy(self->dict + self->dict_len, phrase, length);
+		self->dict_len += length;
+		self->dict[self->dict_len++] = END_OF_PHRASE;
+
+		self->start[d + 1] = self->dict_len;
+		self->hash[d] = hash;
+		self->freq[d] = 0;
+		self->table[slot] = d + 1;
+		self->num_phrases++;
+
+		// Keep the table at most half full.
+		if (2 * self->num_phrases > self->table_size) {
+			free(self->table);
+			self->table_size *= 2;
+			self->table = calloc(self->table_size, sizeof(*self->table));
+			CHECK_MALLOC(self->table);
+
+			mask = self->table_size - 1;
+			for (size_t e = 0; e < self->num_phrases; e++) {
+				size_t k = self->hash[e] & mask;
+				while (self->table[k]) k = (k + 1) & mask;
+				self->table[k] = e + 1;
+			}
+		}
+	}
+
+	if (self->length >= UINT32_MAX - 1) return 1;
+
+	if (self->length == self->capacity) {
+		self->capacity *= 2;
+		self->P = realloc(self->P, self->capacity * sizeof(*self->P));
+		self->pos = realloc(self->pos, self->capacity * sizeof(*self->pos));
+		CHECK_MALLOC(self->P);
+		CHECK_MALLOC(self->pos);
+	}
+
+	self->freq[d]++;
+	self->P[self->length] = d;
+	self->pos[self->length] = pos;
+	self->length++;
+	return 0;
+}
+
+/**
+ * @brief Parses the reversed text into phrases.
+ *
+ * The windows are hashed by a rolling polynomial hash. The text is read
+ * backwards in place.
+ *
+ * @param self - The parse to initialize.
+ * @param S - The text.
+ * @param len - The length of the text.
+ * @returns 0 iff successful.
+ */
+static int pfp_parse(pfp_t *self, const char *S, size_t len) {
+	const size_t w = PFP_WINDOW;
+	*self = (pfp_t){.len = len,
+					.dict_capacity = 1 << 16,
+					.phrase_capacity = 1 << 10,
+					.table_size = 1 << 11,
+					.capacity = 1 << 10};
+
+	self->dict = malloc(self->dict_capacity);
+	self->start = malloc(self->phrase_capacity * sizeof(*self->start));
+	self->hash = malloc(self->phrase_capacity * sizeof(*self->hash));
+	self->freq = malloc(self->phrase_capacity * sizeof(*self->freq));
+	self->table = calloc(self->table_size, sizeof(*self->table));
+	self->P = malloc(self->capacity * sizeof(*self->P));
+	self->pos = malloc(self->capacity * sizeof(*self->pos));
+	CHECK_MALLOC(self->dict);
+	CHECK_MALLOC(self->start);
+	CHECK_MALLOC(self->hash);
+	CHECK_MALLOC(self->freq);
+	CHECK_MALLOC(self->table);
+	CHECK_MALLOC(self->P);
+	CHECK_MALLOC(self->pos);
+	self->start[0] = 0;
+
+	// The phrase read so far; it starts with the window ending the last one.
+	size_t capacity = 1024, used = w;
+	char *phrase = malloc(capacity);
+	CHECK_MALLOC(phrase);
+	memset(phrase, DOLLAR, w);
+
+	const uint64_t base = 0x100000001b3ULL;
+	uint64_t power = 1; // base^w
+	for (size_t k = 0; k < w; k++) {
+		power *= base;
+	}
+
+	uint64_t hash = 0, pos = 0;
+	int check = 0;
+	for (size_t i = 0; i < len && !check; i++) {
+		unsigned char c = S[len - 1 - i];
+		if (used + w >= capacity) {
+			capacity *= 2;
+			phrase = realloc(phrase, capacity);
+			CHECK_MALLOC(phrase);
+		}
+		phrase[used++] = c;
+
+		hash = hash * base + c;
+		if (i >= w) hash -= (unsigned char)S[len - 1 - (i - w)] * power;
+
+		if (i + 1 >= w && mix64(hash) % PFP_MODULUS == 0) {
+			check = pfp_add(self, phrase, used, pos);
+			memmove(phrase, phrase + used - w, w);
+			used = w;
+			pos = i + 1;
+		}
+	}
+
+	memset(phrase + used, DOLLAR, w);
+	if (!check) check = pfp_add(self, phrase, used + w, pos);
+	free(phrase);
+
+	free(self->table);
+	free(self->hash);
+	self->table = NULL;
+	self->hash = NULL;
+
+	return check || self->dict_len >= INT_MAX;
+}
+
+/** @brief Returns the phrase containing `dict[q]`. */
+static size_t pfp_phrase_at(const pfp_t *self, size_t q) {
+	uint64_t upto = self->starts[q / 64] & (((uint64_t)2 << (q % 64)) - 1);
+	return self->starts_rank[q / 64] + __builtin_popcountll(upto) - 1;
+}
+
+/**
+ * @brief Sorts the suffixes of the parse by prefix doubling.
+ *
+ * Every round sorts by the ranks of the first h phrases and of the h phrases
+ * after them, by two counting sorts. This takes O(m log L) time for a parse
+ * of m phrases whose longest repeat has L phrases.
+ *
+ * @param P - The parse as ranks of phrases.
+ * @param m - The length of the parse.
+ * @param d - The number of distinct phrases.
+ * @returns The suffix array; the caller frees it.
+ */
+static uint32_t *pfp_sort(const uint32_t *P, size_t m, size_t d) {
+	size_t range = (m > d ? m : d) + 1;
+	uint32_t *SA = malloc(m * sizeof(*SA));
+	uint32_t *rank = malloc(m * sizeof(*rank));
+	uint32_t *tmp = malloc(m * sizeof(*tmp));
+	uint32_t *count = malloc(range * sizeof(*count));
+	CHECK_MALLOC(SA);
+	CHECK_MALLOC(rank);
+	CHECK_MALLOC(tmp);
+	CHECK_MALLOC(count);
+
+	memcpy(rank, P, m * sizeof(*rank));
+	for (size_t i = 0; i < m; i++) {
+		tmp[i] = i;
+	}
+
+	for (size_t h = 0;; h = h ? 2 * h : 1) {
+		// Order by the second key: the suffixes ending within h phrases
+		// first, then by the rank h phrases further on.
+		if (h) {
+			size_t k = 0;
+			for (size_t i = m > h ? m - h : 0; i < m; i++) {
+				tmp[k++] = i;
+			}
+			for (size_t j = 0; j < m; j++) {
+				if (SA[j] >= h) tmp[k++] = SA[j] - h;
+			}
+		}
+
+		// Stable sort by the ranks of the first h phrases.
+		memset(count, 0, range * sizeof(*count));
+		for (size_t i = 0; i < m; i++) {
+			count[rank[i] + 1]++;
+		}
+		for (size_t r = 1; r < range; r++) {
+			count[r] += count[r - 1];
+		}
+		for (size_t k = 0; k < m; k++) {
+			SA[count[rank[tmp[k]]]++] = tmp[k];
+		}
+
+		if (!h) continue;
+
+		// Rank by the first 2h phrases; -1 marks the end.
+#define SECOND(i) ((i) + h < m ? (int64_t)rank[(i) + h] : -1)
+		tmp[SA[0]] = 0;
+		for (size_t j = 1; j < m; j++) {
+			uint32_t a = SA[j - 1], b = SA[j];
+			int differ = rank[a] != rank[b] || SECOND(a) != SECOND(b);
+			tmp[b] = tmp[a] + differ;
+		}
+#undef SECOND
+
+		uint32_t *swap = rank;
+		rank = tmp;
+		tmp = swap;
+
+		if (rank[SA[m - 1]] == m - 1) break;
+	}
+
+	free(rank);
+	free(tmp);
+	free(count);
+	return SA;
+}
+
+/**
+ * @brief Ranks the phrases and sorts the parse.
+ *
+ * The phrases start in the order of their rank in the suffix array of the
+ * dictionary. Afterwards, the rows of the suffix array of the parse are
+ * listed by the phrase before them.
+ *
+ * @param self - The parse.
+ * @param SA - The suffix array of the dictionary.
+ */
+static void pfp_rank(pfp_t *self, const saidx_t *SA) {
+	size_t words = self->dict_len / 64 + 1;
+	self->starts = calloc(words, sizeof(*self->starts));
+	self->starts_rank = malloc(words * sizeof(*self->starts_rank));
+	CHECK_MALLOC(self->starts);
+	CHECK_MALLOC(self->starts_rank);
+
+	for (size_t d = 0; d < self->num_phrases; d++) {
+		size_t q = self->start[d];
+		self->starts[q / 64] |= (uint64_t)1 << (q % 64);
+	}
+
+	for (size_t k = 0, sum = 0; k < words; k++) {
+		self->starts_rank[k] = sum;
+		sum += __builtin_popcountll(self->starts[k]);
+	}
+
+	size_t d = self->num_phrases, m = self->length;
+	uint32_t *rank = self->rank = malloc(d * sizeof(*rank));
+	self->phrase = malloc(d * sizeof(*self->phrase));
+	CHECK_MALLOC(rank);
+	CHECK_MALLOC(self->phrase);
+
+	for (size_t k = 0, r = 0; k < self->dict_len; k++) {
+		size_t q = SA[k];
+		if (self->starts[q / 64] >> (q % 64) & 1) {
+			size_t phrase = pfp_phrase_at(self, q);
+			rank[phrase] = r;
+			self->phrase[r++] = phrase;
+		}
+	}
+
+	for (size_t t = 0; t < m; t++) {
+		self->P[t] = rank[self->P[t]];
+	}
+
+	self->SA = pfp_sort(self->P, m, d);
+
+	self->rows = malloc(m * sizeof(*self->rows));
+	self->rows_start = malloc((d + 1) * sizeof(*self->rows_start));
+	CHECK_MALLOC(self->rows);
+	CHECK_MALLOC(self->rows_start);
+
+	for (size_t r = 0, sum = 0; r <= d; r++) {
+		self->rows_start[r] = sum;
+		if (r < d) sum += self->freq[self->phrase[r]];
+	}
+
+	uint32_t *next = malloc(d * sizeof(*next));
+	CHECK_MALLOC(next);
+	memcpy(next, self->rows_start, d * sizeof(*next));
+
+	for (size_t j = 0; j < m; j++) {
+		size_t t = self->SA[j] ? self->SA[j] - 1 : m - 1;
+		self->rows[next[self->P[t]]++] = j;
+	}
+	free(next);
+}
+
+static void pfp_free(pfp_t *self) {
+	free(self->dict);
+	free(self->start);
+	free(self->hash);
+	free(self->freq);
+	free(self->table);
+	free(self->P);
+	free(self->pos);
+	free(self->starts);
+	free(self->starts_rank);
+	free(self->rank);
+	free(self->phrase);
+	free(self->SA);
+	free(self->rows);
+	free(self->rows_start);
+	*self = (pfp_t){};
+}
+
+/** @brief The number of fields of a run. */
+#define RUN_FIELDS 4
+
+/** @brief Returns the number of words holding `num` runs. */
+static size_t run_words(const rindex_t *self, size_t num) {
+	return (num * RUN_FIELDS * self->width + 63) / 64;
+}
+
+/** @brief Returns the field at `bit` of the packed runs `words`. */
+static uint64_t run_field(const rindex_t *self, const uint64_t *words,
+						  size_t bit) {
+	size_t word = bit / 64, offset = bit % 64;
+	uint64_t value = words[word] >> offset;
+	if (offset + self->width > 64) value |= words[word + 1] << (64 - offset);
+	return self->width < 64 ? value & (((uint64_t)1 << self->width) - 1)
+							: value;
+}
+
+/** @brief Sets the field at `bit` of the packed runs `words`. */
+static void run_set_field(const rindex_t *self, uint64_t *words, size_t bit,
+						  uint64_t value) {
+	size_t word = bit / 64, offset = bit % 64;
+	uint64_t mask =
+		self->width < 64 ? ((uint64_t)1 << self->width) - 1 : ~(uint64_t)0;
+	words[word] = (words[word] & ~(mask << offset)) | value << offset;
+	if (offset + self->width > 64) {
+		size_t shift = 64 - offset;
+		words[word + 1] = (words[word + 1] & ~(mask >> shift)) | value >> shift;
+	}
+}
+
+/** @brief Returns the first row of run `k` of the character `c`. */
+static uint64_t run_start(const rindex_t *self, unsigned char c, size_t k) {
+	return run_field(self, self->runs[c], k * RUN_FIELDS * self->width);
+}
+
+/** @brief Unpacks run `k` of the character `c`. */
+static rindex_run_t run_get(const rindex_t *self, unsigned char c, size_t k) {
+	const uint64_t *words = self->runs[c];
+	size_t bit = k * RUN_FIELDS * self->width, width = self->width;
+	return (rindex_run_t){.start = run_field(self, words, bit),
+						  .length = run_field(self, words, bit + width),
+						  .rank = run_field(self, words, bit + 2 * width),
+						  .sample = run_field(self, words, bit + 3 * width)};
+}
+
+/** @brief Appends the runs of the BWT to an index row by row. */
+typedef struct run_builder_s {
+	rindex_t *index;
+	/** The room for runs of every character. */
+	size_t capacity[256];
+	/** The number of occurrences of every character so far. */
+	uint64_t occurrences[256];
+	/** The number of rows so far. */
+	uint64_t rows;
+	/** The run of the last row, not yet packed, and its character or -1. */
+	rindex_run_t run;
+	int prev;
+} run_builder_t;
+
+/** @brief Packs the run of the last row into the index. */
+static void run_builder_flush(run_builder_t *self) {
+	rindex_t *index = self->index;
+	int c = self->prev;
+
+	// The sentinel is never searched for; its run is dropped.
+	if (c <= 0) return;
+
+	size_t k = index->num_runs[c]++;
+	if (k == self->capacity[c]) {
+		self->capacity[c] = k ? 2 * k : 64;
+		index->runs[c] = realloc(index->runs[c],
+								 run_words(index, self->capacity[c]) *
+									 sizeof(*index->runs[c]));
+		CHECK_MALLOC(index->runs[c]);
+	}
+
+	uint64_t *words = index->runs[c];
+	size_t bit = k * RUN_FIELDS * index->width, width = index->width;
+	run_set_field(index, words, bit, self->run.start);
+	run_set_field(index, words, bit + width, self->run.length);
+	run_set_field(index, words, bit + 2 * width, self->run.rank);
+	run_set_field(index, words, bit + 3 * width, self->run.sample);
+}
+
+/** @brief Appends `count` rows of the character `c`; the last of them has
+ * the suffix array entry `sample`. */
+static void run_builder_push(run_builder_t *self, unsigned char c,
+							 uint64_t count, uint64_t sample) {
+	if (c != self->prev) {
+		run_builder_flush(self);
+		self->run =
+			(rindex_run_t){.start = self->rows, .rank = self->occurrences[c]};
+		self->prev = c;
+	}
+
+	self->run.length += count;
+	self->run.sample = sample;
+	self->occurrences[c] += count;
+	self->rows += count;
+	self->index->last = sample;
+}
+
+/** @brief A suffix of a phrase and its rows in the suffix array of the
+ * parse, see pfp_t::rows. */
+typedef struct member_s {
+	/** The suffix starts at `dict[q]`. */
+	size_t q;
+	/** The phrase. */
+	size_t phrase;
+	/** The next of its rows and the end. */
+	uint32_t next, end;
+} member_t;
+
+/** @brief Returns the BWT character of a suffix of a phrase at row `j` of
+ * the parse; 0 stands for the sentinel. */
+static unsigned char pfp_bwt(const pfp_t *self, const member_t *member,
+							 uint32_t j) {
+	unsigned char c;
+	if (member->q > self->start[member->phrase]) {
+		c = self->dict[member->q - 1];
+	} else {
+		// A whole phrase is preceded by the one before it in the parse.
+		size_t m = self->length;
+		size_t t = self->SA[j] ? self->SA[j] - 1 : m - 1;
+		size_t before = self->phrase[self->P[t ? t - 1 : m - 1]];
+		c = self->dict[self->start[before + 1] - PFP_WINDOW - 2];
+	}
+
+	return c == DOLLAR ? 0 : c;
+}
+
+/** @brief Returns the position in the reversed text of a suffix of a phrase
+ * at row `j` of the parse. */
+static uint64_t pfp_sa(const pfp_t *self, const member_t *member,
+					   uint32_t j) {
+	size_t m = self->length;
+	size_t t = self->SA[j] ? self->SA[j] - 1 : m - 1;
+	uint64_t pos = self->pos[t] + (member->q - self->start[member->phrase]);
+	return pos < PFP_WINDOW ? self->len : pos - PFP_WINDOW;
+}
+
+/**
+ * @brief Writes the rows of the text suffixes starting with the same suffix
+ * of a phrase.
+ *
+ * Their order is that of the suffixes of the parse after the phrases. If all
+ * of them are preceded by the same character, they form a single block.
+ * Otherwise, the rows of the phrases are merged by a heap.
+ *
+ * @param self - The parse.
+ * @param members - The phrases ending in the same suffix.
+ * @param num - The number of phrases.
+ * @param builder - Receives the rows.
+ */
+static void pfp_write_group(const pfp_t *self, member_t *members, size_t num,
+							run_builder_t *builder) {
+	unsigned char c = pfp_bwt(self, &members[0], members[0].next);
+	int uniform = 1;
+	uint64_t count = 0;
+	member_t *last = &members[0];
+
+	for (size_t k = 0; k < num; k++) {
+		member_t *member = &members[k];
+		if (member->q == self->start[member->phrase] ||
+			pfp_bwt(self, member, member->next) != c) {
+			uniform = 0;
+		}
+
+		count += member->end - member->next;
+		if (self->rows[member->end - 1] > self->rows[last->end - 1]) {
+			last = member;
+		}
+	}
+
+	if (uniform) {
+		uint32_t j = self->rows[last->end - 1];
+		run_builder_push(builder, c, count, pfp_sa(self, last, j));
+		return;
+	}
+
+	// A binary heap of the members by their next row.
+#define ROW(k) (self->rows[members[k].next])
+	size_t *heap = malloc(num * sizeof(*heap));
+	CHECK_MALLOC(heap);
+
+	size_t size = 0;
+	for (size_t k = 0; k < num; k++) {
+		size_t i = size++;
+		for (; i && ROW(heap[(i - 1) / 2]) > ROW(k); i = (i - 1) / 2) {
+			heap[i] = heap[(i - 1) / 2];
+		}
+		heap[i] = k;
+	}
+
+	while (size) {
+		member_t *member = &members[heap[0]];
+		uint32_t j = self->rows[member->next++];
+		run_builder_push(builder, pfp_bwt(self, member, j), 1,
+						 pfp_sa(self, member, j));
+
+		size_t top = heap[0];
+		if (member->next == member->end) top = heap[--size];
+
+		size_t i = 0;
+		while (2 * i + 1 < size) {
+			size_t child = 2 * i + 1;
+			if (child + 1 < size && ROW(heap[child + 1]) < ROW(heap[child])) {
+				child++;
+			}
+			if (ROW(heap[child]) >= ROW(top)) break;
+			heap[i] = heap[child];
+			i = child;
+		}
+		if (size) heap[i] = top;
+	}
+#undef ROW
+
+	free(heap);
+}
+
+/**
+ * @brief Writes the BWT of the reversed text row by row.
+ *
+ * The suffixes of the dictionary are visited in sorted order. Those of more
+ * than ::PFP_WINDOW characters stand for the text suffixes starting within
+ * them. Equal suffixes of different phrases form a group. Only the suffixes
+ * of the first phrase starting with a dollar are skipped: they stand for the
+ * rotations of the text with more than one dollar.
+ *
+ * @param self - The parse.
+ * @param SA - The suffix array of the dictionary.
+ * @param builder - Receives the rows.
+ */
+static void pfp_write_bwt(const pfp_t *self, const saidx_t *SA,
+						  run_builder_t *builder) {
+	size_t capacity = 16, num = 0;
+	member_t *members = malloc(capacity * sizeof(*members));
+	CHECK_MALLOC(members);
+
+	size_t group_length = 0;
+	for (size_t k = 0; k < self->dict_len; k++) {
+		size_t q = SA[k];
+		size_t phrase = pfp_phrase_at(self, q);
+		size_t length = self->start[phrase + 1] - 1 - q;
+
+		if (length <= PFP_WINDOW) continue;
+		if (q > self->start[phrase] && self->dict[q] == DOLLAR) continue;
+
+		if (num && (length != group_length ||
+					memcmp(self->dict + q, self->dict + members[0].q, length))) {
+			pfp_write_group(self, members, num, builder);
+			num = 0;
+		}
+
+		if (num == capacity) {
+			capacity *= 2;
+			members = realloc(members, capacity * sizeof(*members));
+			CHECK_MALLOC(members);
+		}
+
+		size_t rank = self->rank[phrase];
+		members[num++] = (member_t){.q = q,
+									.phrase = phrase,
+									.next = self->rows_start[rank],
+									.end = self->rows_start[rank + 1]};
+		group_length = length;
+	}
+
+	if (num) pfp_write_group(self, members, num, builder);
+
+	free(members);
+}
+
+static int rindex_init_cache(rindex_t *);
+
+/**
+ * @brief Builds the index of a subject by prefix-free parsing.
+ *
+ * Besides the text and the runs, the build needs about five bytes per
+ * character of the dictionary and 20 bytes per phrase of the parse, plus the
+ * memory for sorting them.
+ *
+ * @param self - The index to initialize.
+ * @param S - The subject.
+ * @returns 0 iff successful
+ */
+int rindex_init(rindex_t *self, const seq_t *S) {
+	if (!self || !S || !S->S) return 1;
+
+	*self = (rindex_t){.S = S->S, .len = S->len, .width = 1};
+	while (self->width < 64 && self->len >> self->width) {
+		self->width++;
+	}
+
+	pfp_t pfp;
+	if (pfp_parse(&pfp, S->S, S->len)) {
+		warnx("The dictionary or the parse of the r-index exceeds the "
+			  "technical limit; the reference is not repetitive enough.");
+		pfp_free(&pfp);
+		return 1;
+	}
+
+	pfp.dict[pfp.dict_len] = '\0';
+	saidx_t *SA = esa_suffix_sort(pfp.dict, pfp.dict_len);
+	if (!SA) {
+		pfp_free(&pfp);
+		return 1;
+	}
+
+	pfp_rank(&pfp, SA);
+
+	run_builder_t builder = {.index = self, .prev = -1};
+	pfp_write_bwt(&pfp, SA, &builder);
+	run_builder_flush(&builder);
+
+	free(SA);
+	pfp_free(&pfp);
+
+	if (builder.rows != self->len + 1) return 1;
+
+	uint64_t rows = 0;
+	for (size_t c = 0; c < 256; c++) {
+		self->C[c] = rows;
+		rows += builder.occurrences[c];
+
+		if (self->num_runs[c] < builder.capacity[c]) {
+			self->runs[c] =
+				realloc(self->runs[c], run_words(self, self->num_runs[c]) *
+										   sizeof(*self->runs[c]));
+			CHECK_MALLOC(self->runs[c]);
+		}
+	}
+
+	return rindex_init_cache(self);
+}
+
+/** @brief Returns the number of the first `num` runs of the character `c`
+ * starting at or before `row`. */
+static size_t runs_before(const rindex_t *self, unsigned char c, size_t num,
+						  uint64_t row) {
+	size_t lo = 0, hi = num;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (run_start(self, c, mid) <= row) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/** @brief Returns the number of occurrences of the character of `run` up to
+ * and including `row`, which must not precede the run. */
+static uint64_t run_rank(const rindex_run_t *run, uint64_t row) {
+	uint64_t in_run = row - run->start + 1;
+	return run->rank + (in_run < run->length ? in_run : run->length);
+}
+
+/**
+ * @brief Extends the match of a search state by one character to the right.
+ *
+ * @param self - The index.
+ * @param state - The state to update.
+ * @param c - The next character.
+ * @returns 0 iff the extended match does not occur; `state` is unchanged then.
+ */
+static int rindex_step(const rindex_t *self, rindex_state_t *state,
+					   unsigned char c) {
+	uint64_t sp = state->sp, ep = state->ep;
+
+	size_t num = runs_before(self, c, self->num_runs[c], ep);
+	if (!num) return 0;
+
+	rindex_run_t last = run_get(self, c, num - 1);
+	uint64_t rank_ep = run_rank(&last, ep);
+	uint64_t rank_sp = 0;
+	if (sp) {
+		size_t before = runs_before(self, c, num, sp - 1);
+		if (before) {
+			rindex_run_t run = run_get(self, c, before - 1);
+			rank_sp = run_rank(&run, sp - 1);
+		}
+	}
+
+	if (rank_sp == rank_ep) return 0;
+
+	if (ep < last.start + last.length) {
+		state->toehold--;
+	} else {
+		state->toehold = last.sample - 1;
+	}
+
+	state->l++;
+	state->sp = self->C[c] + rank_sp;
+	state->ep = self->C[c] + rank_ep - 1;
+	return 1;
+}
+
+/**
+ * @brief Fills the cache below a prefix by a depth-first search.
+ *
+ * The entries of prefixes ending the search early get the last state. A
+ * lookup resumes from there and stops just as early.
+ *
+ * @param self - The index.
+ * @param state - The search state of the prefix.
+ * @param code - The codes of the prefix.
+ */
+static void rindex_init_cache_dfs(rindex_t *self, rindex_state_t state,
+								  size_t code) {
+	const alphabet_t *alphabet = self->alphabet;
+	size_t rest = (self->cache_length - state.l) * alphabet->bits;
+
+	if (!rest || state.sp == state.ep) {
+		for (size_t k = code << rest; k < (code + 1) << rest; k++) {
+			self->cache[k] = state;
+		}
+		return;
+	}
+
+	for (size_t x = 0; x < alphabet->size; x++) {
+		rindex_state_t next = state;
+		size_t next_code = code << alphabet->bits | x;
+
+		if (rindex_step(self, &next, alphabet->letters[x])) {
+			rindex_init_cache_dfs(self, next, next_code);
+			continue;
+		}
+
+		rest -= alphabet->bits;
+		for (size_t k = next_code << rest; k < (next_code + 1) << rest; k++) {
+			self->cache[k] = state;
+		}
+		rest += alphabet->bits;
+	}
+}
+
+/** @brief Builds the cache of search states. */
+static int rindex_init_cache(rindex_t *self) {
+	const alphabet_t *alphabet = esa_alphabet();
+	size_t cache_length = esa_cache_length(alphabet);
+
+	self->alphabet = alphabet;
+	self->cache_length = cache_length;
+	self->cache = malloc(((size_t)1 << (alphabet->bits * cache_length)) *
+						 sizeof(*self->cache));
+	CHECK_MALLOC(self->cache);
+
+	rindex_state_t root = {.sp = 0, .ep = self->len, .toehold = self->last};
+	rindex_init_cache_dfs(self, root, 0);
+
+	return 0;
+}
+
+/**
+ * @brief Finds the longest prefix of a query occurring in the subject.
+ *
+ * @param self - The index.
+ * @param query - The query string.
+ * @param qlen - The length of the query.
+ * @param pos - (output parameter) The position of one occurrence of the
+ * prefix in the subject.
+ * @param unique - (output parameter) Set iff the prefix occurs only once.
+ * @returns The length of the prefix.
+ */
+size_t rindex_match(const rindex_t *self, const char *query, size_t qlen,
+					size_t *pos, int *unique) {
+	rindex_state_t state = {.sp = 0, .ep = self->len, .toehold = self->last};
+
+	if (qlen >= self->cache_length) {
+		const alphabet_t *alphabet = self->alphabet;
+		size_t code = 0, k = 0;
+
+		for (; k < self->cache_length; k++) {
+			unsigned char c = alphabet->code[(unsigned char)query[k]];
+			if (!c) break;
+			code = code << alphabet->bits | (c - 1);
+		}
+
+		if (k == self->cache_length) {
+			ESA_CACHE_STATS.hits++;
+			state = self->cache[code];
+		} else {
+			ESA_CACHE_STATS.misses++;
+		}
+	}
+
+	// Without the text, a unique match is extended by the search, too.
+	while (state.l < qlen && (state.sp != state.ep || !self->S) &&
+		   rindex_step(self, &state, query[state.l])) {
+	}
+
+	// The match occupies [toehold, toehold + l) of the reversed text.
+	size_t start = self->len - state.toehold - state.l;
+	size_t l = state.l;
+
+	// A unique match can only continue at its single occurrence.
+	if (state.sp == state.ep && self->S) {
+		while (l < qlen && start + l < self->len &&
+			   self->S[start + l] == query[l]) {
+			l++;
+		}
+	}
+
+	*pos = start;
+	*unique = state.sp == state.ep;
+	return l;
+}
+
+/** @brief Returns 1 iff `query[from..from+length)` occurs in the subject. */
+static int rindex_occurs(const rindex_t *self, const char *query, size_t from,
+						 size_t length) {
+	size_t pos;
+	int unique;
+	return rindex_match(self, query + from, length, &pos, &unique) == length;
+}
+
+/**
+ * @brief Finds how far a unique match extends to the left, without the text.
+ *
+ * The match extended by e characters occurs iff it occurs e positions before
+ * the match, as the match itself is unique. So the longest extension is found
+ * by an exponential and a binary search over e.
+ *
+ * @param self - The index.
+ * @param query - The query string.
+ * @param pos_Q - The position of the match in the query.
+ * @param length - The length of the match.
+ * @returns The number of characters before the match in both the query and
+ * the subject that are equal.
+ */
+size_t rindex_extend_left(const rindex_t *self, const char *query,
+						  size_t pos_Q, size_t length) {
+	size_t good = 0, bad = pos_Q + 1;
+	for (size_t e = 1; e < bad; e *= 2) {
+		if (!rindex_occurs(self, query, pos_Q - e, length + e)) {
+			bad = e;
+			break;
+		}
+		good = e;
+	}
+
+	while (bad - good > 1) {
+		size_t e = good + (bad - good) / 2;
+		if (rindex_occurs(self, query, pos_Q - e, length + e)) {
+			good = e;
+		} else {
+			bad = e;
+		}
+	}
+
+	return good;
+}
+
+/** @brief Returns the number of runs in the BWT. */
+size_t rindex_runs(const rindex_t *self) {
+	size_t runs = 0;
+	for (size_t c = 0; c < 256; c++) {
+		runs += self->num_runs[c];
+	}
+	return runs;
+}
+
+/** @brief Returns the number of bytes used by the index and, unless it was
+ * dropped, the text. */
+size_t rindex_bytes(const rindex_t *self) {
+	size_t bytes = (self->S ? self->len + 1 : 0) + sizeof(*self);
+	for (size_t c = 0; c < 256; c++) {
+		bytes += run_words(self, self->num_runs[c]) * sizeof(*self->runs[c]);
+	}
+	bytes += ((size_t)1 << (self->alphabet->bits * self->cache_length)) *
+			 sizeof(*self->cache);
+	return bytes;
+}
+
+void rindex_free(rindex_t *self) {
+	for (size_t c = 0; c < 256; c++) {
+		free(self->runs[c]);
+	}
+	free(self->cache);
+	*self = (rindex_t){};
+}
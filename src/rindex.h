@@ -0,0 +1,81 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the run-length compressed
+ * index in rindex.c.
+ */
+#ifndef _RINDEX_H_
+#define _RINDEX_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "esa.h"
+#include "sequence.h"
+
+/**
+ * @brief A maximal run of equal characters in the BWT.
+ *
+ * The index stores every field in rindex_t::width bits only.
+ */
+typedef struct rindex_run_s {
+	/** The first row of the run. */
+	uint64_t start;
+	/** The number of rows. */
+	uint64_t length;
+	/** The number of occurrences of the character before the run. */
+	uint64_t rank;
+	/** The suffix array entry of the last row. */
+	uint64_t sample;
+} rindex_run_t;
+
+/**
+ * @brief The state of a backward search: a match of length `l`, the range of
+ * rows whose suffixes start with it and one of its occurrences.
+ */
+typedef struct rindex_state_s {
+	uint64_t l, sp, ep;
+	/** The suffix array entry of row `ep`. */
+	uint64_t toehold;
+} rindex_state_t;
+
+/**
+ * @brief A run-length compressed BWT with the suffix array sampled at the end
+ * of every run; its size depends on the number of runs only.
+ *
+ * The BWT is built over the reversed text, so that a backward search extends
+ * a match to the right, just like get_match().
+ */
+typedef struct rindex_s {
+	/** The text; kept for extending matches unless it was dropped, see
+		::F_DROP_TEXT. */
+	const char *S;
+	/** The length of the text. */
+	uint64_t len;
+	/** The packed runs of every character, sorted by row. */
+	uint64_t *runs[256];
+	/** The number of runs of every character. */
+	size_t num_runs[256];
+	/** The number of bits of every field of a run; enough for `len`. */
+	size_t width;
+	/** The number of rows starting with a character smaller than `c`. */
+	uint64_t C[256];
+	/** The suffix array entry of the last row. */
+	uint64_t last;
+	/** The search states of all prefixes of length `cache_length`, indexed
+		like the LCP-interval cache of an ESA. */
+	rindex_state_t *cache;
+	/** The alphabet the cache is built for. */
+	const struct alphabet_s *alphabet;
+	/** The prefix length up to which searches are cached. */
+	size_t cache_length;
+} rindex_t;
+
+int rindex_init(rindex_t *, const seq_t *S);
+size_t rindex_match(const rindex_t *, const char *query, size_t qlen,
+					size_t *pos, int *unique);
+size_t rindex_extend_left(const rindex_t *, const char *query, size_t pos_Q,
+						  size_t length);
+size_t rindex_runs(const rindex_t *);
+size_t rindex_bytes(const rindex_t *);
+void rindex_free(rindex_t *);
+
+#endif // _RINDEX_H_
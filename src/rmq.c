@@ -0,0 +1,158 @@
+/**
+ * @file
+ * @brief Range minimum queries
+ *
+ * The array is split into blocks of ::RMQ_BLOCK values. A sparse table holds
+ * the minima of all runs of 2^t blocks. A query scans at most two partial
+ * blocks and looks up two entries of the table. Searching for the nearest
+ * value below a bound skips blocks by binary lifting over the levels. The
+ * table takes about `n / RMQ_BLOCK * log(n / RMQ_BLOCK)` values.
+ */
+#include <stdlib.h>
+
+#include "global.h"
+#include "rmq.h"
+
+/**
+ * @brief Builds the range minima of an array.
+ *
+ * @param self - The structure to initialize.
+ * @param A - The array; has to outlive `self`.
+ * @param n - The number of values.
+ * @returns 0 iff successful
+ */
+int rmq_init(rmq_t *self, const saidx_t *A, size_t n) {
+	if (!self || !A) return 1;
+
+	*self = (rmq_t){.A = A, .n = n};
+	size_t blocks = (n + RMQ_BLOCK - 1) / RMQ_BLOCK;
+	if (!blocks) return 0;
+
+	saidx_t *base = self->table[0] = malloc(blocks * sizeof(*base));
+	CHECK_MALLOC(base);
+
+	for (size_t b = 0; b < blocks; b++) {
+		saidx_t min = A[b * RMQ_BLOCK];
+		for (size_t k = b * RMQ_BLOCK; k < n && k < (b + 1) * RMQ_BLOCK; k++) {
+			if (A[k] < min) min = A[k];
+		}
+		base[b] = min;
+	}
+
+	self->levels = 1;
+	for (size_t t = 1; ((size_t)1 << t) <= blocks; t++) {
+		size_t width = (size_t)1 << (t - 1);
+		const saidx_t *prev = self->table[t - 1];
+		saidx_t *cur = self->table[t] = malloc(blocks * sizeof(*cur));
+		CHECK_MALLOC(cur);
+
+		for (size_t b = 0; b + 2 * width <= blocks; b++) {
+			saidx_t x = prev[b], y = prev[b + width];
+			cur[b] = x < y ? x : y;
+		}
+		self->levels++;
+	}
+
+	return 0;
+}
+
+/** @brief Returns the minimum of `A[a..b]`; `a <= b`. */
+saidx_t rmq_min(const rmq_t *self, size_t a, size_t b) {
+	const saidx_t *A = self->A;
+	size_t first = a / RMQ_BLOCK, last = b / RMQ_BLOCK;
+	saidx_t min = A[a];
+
+	if (first == last) {
+		for (size_t k = a; k <= b; k++) {
+			if (A[k] < min) min = A[k];
+		}
+		return min;
+	}
+
+	for (size_t k = a; k < (first + 1) * RMQ_BLOCK; k++) {
+		if (A[k] < min) min = A[k];
+	}
+	for (size_t k = last * RMQ_BLOCK; k <= b; k++) {
+		if (A[k] < min) min = A[k];
+	}
+
+	if (last - first > 1) {
+		size_t count = last - first - 1, t = 0;
+		while (((size_t)2 << t) <= count) {
+			t++;
+		}
+
+		saidx_t x = self->table[t][first + 1];
+		saidx_t y = self->table[t][last - ((size_t)1 << t)];
+		if (x < min) min = x;
+		if (y < min) min = y;
+	}
+
+	return min;
+}
+
+/** @brief Returns the largest `k <= i` with `A[k] < t`, or `(size_t)-1`. */
+size_t rmq_prev_less(const rmq_t *self, size_t i, saidx_t t) {
+	const saidx_t *A = self->A;
+	size_t block = i / RMQ_BLOCK;
+
+	for (size_t k = i + 1; k-- > block * RMQ_BLOCK;) {
+		if (A[k] < t) return k;
+	}
+
+	// Skip the longest run of blocks before `block` whose values are all >= t.
+	for (size_t level = self->levels; level--;) {
+		size_t width = (size_t)1 << level;
+		if (block >= width && self->table[level][block - width] >= t) {
+			block -= width;
+		}
+	}
+
+	if (!block) return (size_t)-1;
+
+	for (size_t k = block * RMQ_BLOCK; k-- > (block - 1) * RMQ_BLOCK;) {
+		if (A[k] < t) return k;
+	}
+
+	return (size_t)-1; // unreachable
+}
+
+/** @brief Returns the smallest `k >= i` with `A[k] < t`, or `n`. */
+size_t rmq_next_less(const rmq_t *self, size_t i, saidx_t t) {
+	const saidx_t *A = self->A;
+	size_t n = self->n;
+	size_t blocks = (n + RMQ_BLOCK - 1) / RMQ_BLOCK;
+	size_t block = i / RMQ_BLOCK + 1;
+
+	for (size_t k = i; k < n && k < block * RMQ_BLOCK; k++) {
+		if (A[k] < t) return k;
+	}
+
+	// Skip the longest run of blocks from `block` whose values are all >= t.
+	for (size_t level = self->levels; level--;) {
+		size_t width = (size_t)1 << level;
+		if (block + width <= blocks && self->table[level][block] >= t) {
+			block += width;
+		}
+	}
+
+	for (size_t k = block * RMQ_BLOCK; k < n && k < (block + 1) * RMQ_BLOCK;
+		 k++) {
+		if (A[k] < t) return k;
+	}
+
+	return n;
+}
+
+/** @brief Returns the number of bytes used by the table. */
+size_t rmq_bytes(const rmq_t *self) {
+	size_t blocks = (self->n + RMQ_BLOCK - 1) / RMQ_BLOCK;
+	return self->levels * blocks * sizeof(saidx_t);
+}
+
+void rmq_free(rmq_t *self) {
+	for (size_t t = 0; t < self->levels; t++) {
+		free(self->table[t]);
+	}
+	*self = (rmq_t){};
+}
@@ -0,0 +1,38 @@
+/**
+ * @file
+ * @brief This header contains the declarations for range minimum queries in
+ * rmq.c.
+ */
+#ifndef _RMQ_H_
+#define _RMQ_H_
+
+#include <stdlib.h>
+#include "esa.h"
+
+/**
+ * @brief Range minima of an array: the minimum of every block of ::RMQ_BLOCK
+ * values and a sparse table over those.
+ */
+typedef struct rmq_s {
+	/** The array; not owned. */
+	const saidx_t *A;
+	/** The number of values. */
+	size_t n;
+	/** `table[t][b]` is the minimum of the 2^t blocks starting with block
+		b. */
+	saidx_t *table[64];
+	/** The number of levels of the table. */
+	size_t levels;
+} rmq_t;
+
+/** @brief The number of values per block. */
+#define RMQ_BLOCK 64
+
+int rmq_init(rmq_t *, const saidx_t *A, size_t n);
+saidx_t rmq_min(const rmq_t *, size_t a, size_t b);
+size_t rmq_prev_less(const rmq_t *, size_t i, saidx_t t);
+size_t rmq_next_less(const rmq_t *, size_t i, saidx_t t);
+size_t rmq_bytes(const rmq_t *);
+void rmq_free(rmq_t *);
+
+#endif // _RMQ_H_
@@ -67,8 +67,10 @@ seq_t *dsa_data(dsa_t *A) {
  * @brief Convert an array of multiple sequences into a single sequence.
  *
  * This function joins all sequences contained in an array into one
- * long sequence. The sequences are separated by a `!` character. The
- * caller has to free the initial array.
+ * long sequence. The sequences are separated by a `!` character. Their
+ * strings are moved into the new sequence one by one, so that joining takes
+ * little more memory than the sequences themselves. The caller has to free
+ * the initial array.
  *
  * @returns A new sequence representation the union of the array.
  */
@@ -95,21 +97,20 @@ seq_t dsa_join(dsa_t *A) {
 		total += it->len + 1;
 	}
 
-	// A single malloc for the whole new sequence
-	char *ptr = malloc(total);
+	// Grow the first sequence to hold all of them
+	char *ptr = realloc(data[0].S, total);
 	CHECK_MALLOC(ptr);
-	char *next = ptr;
+	data[0].S = NULL;
+	char *next = ptr + data[0].len;
 
-	// Copy all old sequences and add a `!` in between
+	// Append all other sequences with a `!` in between
 
-	it = data;
-	memcpy(next, it->S, it->len);
-	next += it->len;
-
-	for (i = 1, it++; i < A->size; i++, it++) {
+	for (i = 1, it = data + 1; i < A->size; i++, it++) {
 		*next++ = '!';
 		memcpy(next, it->S, it->len);
 		next += it->len;
+		free(it->S);
+		it->S = NULL;
 	}
 
 	// Don't forget the null byte.
@@ -209,6 +210,8 @@ double calc_gc(const seq_t *S) {
 /** @brief Prepares a sequences to be used as the subject in a comparison. */
 int seq_subject_init(seq_t *S) {
 	S->gc = calc_gc(S);
+	// The r-index reads the forward strand in place.
+	if (FLAGS & F_RINDEX) return 0;
 	// S->RS = catcomp(S->S, S->len);
 	S->RS = strdup(S->S);
 	if (!S->RS) return 1;
@@ -246,8 +249,9 @@ int seq_init(seq_t *S, const char *seq, const char *name) {
 	// characters.
 	S->len = strlen(S->S);
 
+	// The r-index uses 64 bit positions.
 	const size_t LENGTH_LIMIT = (INT_MAX - 1) / 2;
-	if (S->len > LENGTH_LIMIT) {
+	if (!(FLAGS & F_RINDEX) && S->len > LENGTH_LIMIT) {
 		warnx("The input sequence %s is too long. The technical limit is %zu.",
 			  S->name, LENGTH_LIMIT);
 		return 3;
@@ -256,14 +260,44 @@ int seq_init(seq_t *S, const char *seq, const char *name) {
 	return 0;
 }
 
+/**
+ * @brief Restricts a protein sequence to the 20 amino acids.
+ *
+ * Lower case letters are converted to upper case and every other character is
+ * replaced by X. A flag is set if such a character was encountered.
+ */
+static void normalize_protein(seq_t *S) {
+	char local_non_acgt = 0;
+	for (char *p = S->S; *p; p++) {
+		char c = toupper((unsigned char)*p);
+		if (c == '!' || strchr(PROTEIN_LETTERS, c)) {
+			*p = c;
+			continue;
+		}
+
+		*p = 'X';
+		local_non_acgt = 1;
+	}
+
+	if (local_non_acgt) {
+#pragma omp atomic write
+		NON_ACGT = 1;
+	}
+}
+
 /**
  * @brief Restricts a sequence characters set to ACGT.
  *
  * This function strips a sequence of non ACGT characters and converts acgt to
  * the upper case equivalent. A flag is set if a non-canonical character was
- * encountered.
+ * encountered. With F_PROTEIN, see normalize_protein() instead.
  */
 void normalize(seq_t *S) {
+	if (FLAGS & F_PROTEIN) {
+		normalize_protein(S);
+		return;
+	}
+
 	char *p, *q;
 	char local_non_acgt = 0;
 	for (p = q = S->S; *p; p++) {
@@ -285,7 +319,7 @@ void normalize(seq_t *S) {
 	}
 	*q = '\0';
 	if (local_non_acgt) {
-#pragma omp atomic
-		FLAGS |= F_NON_ACGT;
+#pragma omp atomic write
+		NON_ACGT = 1;
 	}
 }
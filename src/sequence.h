@@ -35,6 +35,9 @@ typedef struct seq_s {
 	double gc;
 } seq_t;
 
+/** @brief The amino acids as used with F_PROTEIN. */
+#define PROTEIN_LETTERS "ACDEFGHIKLMNPQRSTVWY"
+
 void seq_free(seq_t *S);
 int seq_subject_init(seq_t *S);
 void seq_subject_free(seq_t *S);
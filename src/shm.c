@@ -0,0 +1,275 @@
+/**
+ * @file
+ * @brief A shared memory interface to a resident index
+ *
+ * Pipeline stages running on the same machine submit queries at high rates.
+ * Copying every query and its MUMs through a socket would cost about as much
+ * as the lookups. Instead, the client writes the query into a slot of a shared
+ * segment and the server writes binary MUM records right next to it; see
+ * shm.h for the protocol.
+ *
+ * Notification uses process-shared semaphores within the segment. Unlike an
+ * eventfd, these need no file descriptor passing between unrelated processes.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esa.h"
+#include "global.h"
+#include "metrics.h"
+#include "process.h"
+#include "sequence.h"
+#include "shm.h"
+
+/** @brief Set by a signal to stop the server. */
+static volatile sig_atomic_t STOP = 0;
+
+static void stop_handler(int signal) {
+	(void)signal;
+	STOP = 1;
+}
+
+/** @brief A sink writing anchors into the records of a slot. */
+typedef struct record_sink_s {
+	anchor_sink_t base;
+	shm_record_t *records;
+	uint64_t capacity, size;
+	uint32_t strand;
+	int overflow;
+} record_sink_t;
+
+static void push_record(anchor_sink_t *base, const anchor_t *anchor) {
+	record_sink_t *self = (record_sink_t *)base;
+
+	if (self->size == self->capacity) {
+		self->overflow = 1;
+		return;
+	}
+
+	self->records[self->size++] = (shm_record_t){.pos_S = anchor->pos_S,
+												 .pos_Q = anchor->pos_Q,
+												 .length = anchor->length,
+												 .mismatches =
+													 anchor->mismatches,
+												 .strand = self->strand};
+}
+
+/** @brief Checks that a query is normalized, i.e. consists of ACGTN only, or
+ * with F_PROTEIN, of the amino acids and X. */
+static int valid_query(const char *query, size_t len) {
+	if (FLAGS & F_PROTEIN) {
+		for (size_t i = 0; i < len; i++) {
+			if (query[i] != 'X' &&
+				!PROTEIN_ALPHABET.code[(unsigned char)query[i]]) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		switch (query[i]) {
+			case 'A':
+			case 'C':
+			case 'G':
+			case 'T':
+			case 'N': break;
+			default: return 0;
+		}
+	}
+	return 1;
+}
+
+/** @brief Returns the time as of CLOCK_MONOTONIC in nanoseconds. */
+static uint64_t monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** @brief Answers the request in slot `k`. */
+static void serve_slot(const subject_t *I, shm_header_t *header, uint64_t k) {
+	shm_slot_t *slot = &shm_slots(header)[k];
+	const char *query = shm_query(header, k);
+	size_t len = slot->query_len;
+
+	record_sink_t sink = {.base = {.push = push_record},
+						  .records = shm_records(header, k),
+						  .capacity = header->record_capacity};
+
+	slot->num_records = 0;
+
+	int strands = slot->flags & (SHM_FORWARD | SHM_REVCOMP);
+	if (!strands) {
+		strands = (FLAGS & F_FORWARD ? SHM_FORWARD : 0) |
+				  (FLAGS & F_REVCOMP ? SHM_REVCOMP : 0);
+	}
+
+	if (len > header->query_capacity || !valid_query(query, len) ||
+		(FLAGS & F_PROTEIN && strands & SHM_REVCOMP)) {
+		slot->status = SHM_INVALID;
+		return;
+	}
+
+	if (len && strands & SHM_FORWARD) {
+		sink.strand = 0;
+		query_anchors(I, query, len, &sink.base);
+	}
+
+	if (len && strands & SHM_REVCOMP) {
+		char *R = revcomp(query, len);
+		sink.strand = 1;
+		query_anchors(I, R, len, &sink.base);
+		free(R);
+	}
+
+	slot->num_records = sink.size;
+	slot->status = sink.overflow ? SHM_OVERFLOW : SHM_OK;
+}
+
+/** @brief Answers the request in slot `k` and records its metrics. */
+static void serve_slot_measured(const subject_t *I, shm_header_t *header,
+								uint64_t k) {
+	shm_slot_t *slot = &shm_slots(header)[k];
+	esa_cache_stats_t cache = ESA_CACHE_STATS;
+	uint64_t start = monotonic_ns();
+	uint64_t submitted = slot->submitted;
+
+	serve_slot(I, header, k);
+
+	metrics_query_t query = {
+		.wait = submitted && submitted <= start ? (start - submitted) * 1e-9
+												: -1.0,
+		.match = (monotonic_ns() - start) * 1e-9,
+		.bases = slot->status == SHM_INVALID ? 0 : slot->query_len,
+		.mums = slot->num_records,
+		.cache_hits = ESA_CACHE_STATS.hits - cache.hits,
+		.cache_misses = ESA_CACHE_STATS.misses - cache.misses,
+		.status = slot->status};
+
+	metrics_record(&query);
+}
+
+/**
+ * @brief Creates and maps the segment.
+ *
+ * @returns The initialized header and its total size via `size`.
+ */
+static shm_header_t *shm_create(const char *name, size_t *size) {
+	uint64_t num_slots = SHM_SLOTS;
+	uint64_t query_offset = sizeof(shm_header_t) + num_slots * sizeof(shm_slot_t);
+	query_offset = (query_offset + 4095) & ~(uint64_t)4095;
+	uint64_t result_offset = query_offset + num_slots * SHM_QUERY_CAPACITY;
+
+	*size = result_offset +
+			num_slots * SHM_RECORD_CAPACITY * sizeof(shm_record_t);
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		err(errno, "shm_open %s", name);
+	}
+
+	if (ftruncate(fd, *size)) {
+		int error = errno;
+		shm_unlink(name);
+		err(error, "ftruncate %s", name);
+	}
+
+	void *ptr = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		int error = errno;
+		shm_unlink(name);
+		err(error, "mmap %s", name);
+	}
+
+	shm_header_t *header = ptr;
+	*header = (shm_header_t){.num_slots = num_slots,
+							 .query_capacity = SHM_QUERY_CAPACITY,
+							 .record_capacity = SHM_RECORD_CAPACITY,
+							 .query_offset = query_offset,
+							 .result_offset = result_offset};
+
+	for (uint64_t k = 0; k < num_slots; k++) {
+		shm_slot_t *slot = &shm_slots(header)[k];
+		if (sem_init(&slot->free, 1, 1) || sem_init(&slot->ready, 1, 0) ||
+			sem_init(&slot->done, 1, 0)) {
+			int error = errno;
+			shm_unlink(name);
+			err(error, "sem_init");
+		}
+	}
+
+	// Clients may only start once everything else is set.
+	__atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+	return header;
+}
+
+/**
+ * @brief Serves queries submitted via the shared segment `name`.
+ *
+ * Returns after a request with ::SHM_SHUTDOWN or on SIGINT or SIGTERM. The
+ * segment is removed then.
+ *
+ * @param I - The subject and its index.
+ * @param name - The name of the segment as for shm_open(), e.g. "/tummer".
+ */
+void shm_serve(const subject_t *I, const char *name) {
+	size_t size;
+	shm_header_t *header = shm_create(name, &size);
+
+	// No SA_RESTART, so a blocked sem_wait() returns on a signal.
+	struct sigaction action = {.sa_handler = stop_handler};
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Serving queries via shared memory %s\n", name);
+	}
+
+	if (METRICS_ADDRESS) {
+		size_t bytes =
+			FLAGS & F_RINDEX ? rindex_bytes(&I->R) : esa_bytes(&I->E);
+		metrics_start(METRICS_ADDRESS, bytes);
+	}
+
+	size_t served = 0;
+	for (uint64_t tail = 0; !STOP; tail++) {
+		uint64_t k = tail % header->num_slots;
+		shm_slot_t *slot = &shm_slots(header)[k];
+
+		while (sem_wait(&slot->ready)) {
+			if (errno != EINTR) err(errno, "sem_wait");
+			if (STOP) break;
+		}
+		if (STOP) break;
+
+		int shutdown = slot->flags & SHM_SHUTDOWN;
+		if (METRICS_ADDRESS) {
+			serve_slot_measured(I, header, k);
+		} else {
+			serve_slot(I, header, k);
+		}
+		served++;
+		sem_post(&slot->done);
+
+		if (shutdown) break;
+	}
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Served %zu requests\n", served);
+	}
+
+	metrics_stop();
+	shm_unlink(name);
+	munmap(header, size);
+}
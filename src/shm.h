@@ -0,0 +1,118 @@
+/**
+ * @file
+ * @brief This header describes the shared memory interface of shm.c. Clients
+ * include it to talk to a TUMmer started with `--shm NAME`.
+ *
+ * The segment `/NAME` starts with a ::shm_header_t followed by `num_slots`
+ * slots, the query area and the result area. Each slot owns `query_capacity`
+ * bytes of the query area and `record_capacity` records of the result area,
+ * located via shm_query() and shm_records(). A client submits a query as
+ * follows.
+ *
+ *  1. Wait until `magic` equals ::SHM_MAGIC.
+ *  2. Claim a ticket via `__atomic_fetch_add(&header->head, 1, ...)`. The
+ *     slot is the ticket modulo `num_slots`.
+ *  3. `sem_wait(&slot->free)`.
+ *  4. Copy the normalized query, i.e. upper case ACGTN only (or amino acids
+ *     and X with `--protein`), into the slot's query area and set
+ *     `query_len`, `flags` and optionally `submitted`.
+ *  5. `sem_post(&slot->ready)`.
+ *  6. `sem_wait(&slot->done)`, then read `status`, `num_records` and the
+ *     records.
+ *  7. `sem_post(&slot->free)`.
+ *
+ * The server handles the slots in ticket order. A client that claims a ticket
+ * must complete these steps, or the server stalls.
+ */
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <semaphore.h>
+#include <stdint.h>
+
+/** @brief Marks a fully initialized segment. */
+#define SHM_MAGIC 0x314d48535245554dULL
+
+/** @brief The default number of slots. */
+#define SHM_SLOTS 8
+/** @brief The default size of the query area of a slot in bytes. */
+#define SHM_QUERY_CAPACITY ((uint64_t)16 << 20)
+/** @brief The default number of records of a slot. */
+#define SHM_RECORD_CAPACITY ((uint64_t)1 << 20)
+
+/** @brief The flags of a request. Without strand flags, those of the server
+ * are used. */
+enum {
+	SHM_FORWARD = 1,
+	SHM_REVCOMP = 2,
+	/** Stops the server after answering this request. */
+	SHM_SHUTDOWN = 4,
+};
+
+/** @brief The status of an answer. */
+enum {
+	SHM_OK = 0,
+	/** The query is too long, contains characters other than ACGTN (the
+	 * amino acids and X with `--protein`) or asks for the reverse complement
+	 * of a protein. */
+	SHM_INVALID = 1,
+	/** There were more MUMs than records; the first ones are returned. */
+	SHM_OVERFLOW = 2,
+};
+
+/** @brief A MUM as returned to the client. Positions start at 0. */
+typedef struct shm_record_s {
+	uint64_t pos_S, pos_Q, length;
+	/** The number of mismatches within a bridged MUM. */
+	uint32_t mismatches;
+	/** 0 for the forward strand and 1 for the reverse complement. */
+	uint32_t strand;
+} shm_record_t;
+
+/** @brief A slot for one request. */
+typedef struct shm_slot_s {
+	sem_t free, ready, done;
+	uint32_t flags;
+	int32_t status;
+	uint64_t query_len;
+	/** The time of submission as of CLOCK_MONOTONIC in nanoseconds; only
+	 * used for metrics. May be 0. */
+	uint64_t submitted;
+	uint64_t num_records;
+} shm_slot_t;
+
+/** @brief The start of the segment. */
+typedef struct shm_header_s {
+	uint64_t magic;
+	uint64_t num_slots;
+	uint64_t query_capacity;
+	uint64_t record_capacity;
+	/** The offsets of the query and the result area. */
+	uint64_t query_offset, result_offset;
+	/** The next ticket; only changed atomically. */
+	uint64_t head;
+} shm_header_t;
+
+/** @brief Returns the slots of a segment. */
+static inline shm_slot_t *shm_slots(shm_header_t *header) {
+	return (shm_slot_t *)(header + 1);
+}
+
+/** @brief Returns the query area of slot `k`. */
+static inline char *shm_query(shm_header_t *header, uint64_t k) {
+	return (char *)header + header->query_offset + k * header->query_capacity;
+}
+
+/** @brief Returns the records of slot `k`. */
+static inline shm_record_t *shm_records(shm_header_t *header, uint64_t k) {
+	return (shm_record_t *)((char *)header + header->result_offset) +
+		   k * header->record_capacity;
+}
+
+#ifndef SHM_CLIENT
+#include "process.h"
+
+void shm_serve(const subject_t *I, const char *name);
+#endif
+
+#endif // _SHM_H_
@@ -0,0 +1,169 @@
+/**
+ * @file
+ * @brief Minimizer sketches
+ *
+ * Most pairs of unrelated genomes do not share a single match as long as the
+ * MUM threshold. To skip such pairs cheaply, both sequences are sketched
+ * first. A sketch holds the canonical (w,k)-minimizers of a sequence, i.e.
+ * the smallest k-mer hash in each window of w consecutive k-mers.
+ *
+ * If two sequences share a window of `w + k - 1` characters, they also share
+ * its minimizer. As long as `w + k - 1` does not exceed the MUM threshold,
+ * every MUM therefore contributes at least one shared minimizer and a pair
+ * without any shared minimizer can be skipped without losing a MUM. Because
+ * canonical k-mers are used, this holds for both strands.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "global.h"
+#include "hash.h"
+#include "sketch.h"
+
+/** @brief The k-mer length used for long thresholds. */
+static const size_t SKETCH_K = 16;
+
+/**
+ * @brief Map a character to a three bit code.
+ *
+ * Anything but ACGT is mapped to the same code. That way two identical
+ * strings always get identical codes.
+ */
+static inline uint64_t sketch_code(char c) {
+	switch (c) {
+		case 'A': return 0;
+		case 'C': return 1;
+		case 'G': return 2;
+		case 'T': return 3;
+	}
+	return 4;
+}
+
+static int cmp_hash(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Chooses the sketch parameters for a MUM threshold.
+ *
+ * The parameters are chosen such that `w + k - 1 == threshold`. Thus a MUM
+ * always yields a shared minimizer.
+ *
+ * @param threshold - The minimum length of a MUM.
+ * @param k - (output parameter) The k-mer length.
+ * @param w - (output parameter) The number of k-mers per window.
+ */
+void sketch_params(size_t threshold, size_t *k, size_t *w) {
+	if (threshold == 0) threshold = 1;
+
+	*k = threshold < SKETCH_K ? threshold : SKETCH_K;
+	*w = threshold - *k + 1;
+}
+
+/**
+ * @brief Computes the sketch of a sequence.
+ *
+ * @param self - The sketch to initialize.
+ * @param S - The sequence.
+ * @param len - The length of the sequence.
+ * @param k - The k-mer length.
+ * @param w - The number of k-mers per window.
+ * @returns 0 iff successful
+ */
+int sketch_init(sketch_t *self, const char *S, size_t len, size_t k,
+				size_t w) {
+	if (!self || !S || k == 0 || w == 0) return 1;
+
+	*self = (sketch_t){};
+
+	if (len < k + w - 1) return 0;
+
+	size_t num_kmers = len - k + 1;
+	const uint64_t mask = (k * 3 < 64) ? (1ULL << (k * 3)) - 1 : ~0ULL;
+	const size_t shift = 3 * (k - 1);
+
+	uint64_t *hashes = malloc(num_kmers * sizeof(*hashes));
+	CHECK_MALLOC(hashes);
+
+	// A monotone queue of k-mer positions with increasing hashes.
+	size_t *queue = malloc(w * sizeof(*queue));
+	uint64_t *values = malloc(w * sizeof(*values));
+	CHECK_MALLOC(queue);
+	CHECK_MALLOC(values);
+	size_t head = 0, tail = 0; // number of elements popped from each end
+
+	uint64_t fw = 0, rc = 0;
+	size_t size = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		uint64_t c = sketch_code(S[i]);
+		fw = ((fw << 3) | c) & mask;
+		rc = (rc >> 3) | ((c < 4 ? 3 - c : 4) << shift);
+
+		if (i + 1 < k) continue;
+
+		size_t pos = i + 1 - k;
+		uint64_t hash = mix64(fw < rc ? fw : rc);
+
+		// drop elements which left the window
+		if (tail > head && queue[head % w] + w <= pos) {
+			head++;
+		}
+
+		// drop elements that can never become a minimizer again
+		while (tail > head && values[(tail - 1) % w] > hash) {
+			tail--;
+		}
+		queue[tail % w] = pos;
+		values[tail % w] = hash;
+		tail++;
+
+		if (pos + 1 < w) continue;
+
+		uint64_t min = values[head % w];
+		if (size == 0 || hashes[size - 1] != min) {
+			hashes[size++] = min;
+		}
+	}
+
+	free(queue);
+	free(values);
+
+	qsort(hashes, size, sizeof(*hashes), cmp_hash);
+
+	size_t unique = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (unique == 0 || hashes[unique - 1] != hashes[i]) {
+			hashes[unique++] = hashes[i];
+		}
+	}
+
+	self->hashes = hashes;
+	self->size = unique;
+	return 0;
+}
+
+/** @brief Returns the number of hashes two sketches have in common. */
+size_t sketch_shared(const sketch_t *A, const sketch_t *B) {
+	size_t i = 0, j = 0, shared = 0;
+
+	while (i < A->size && j < B->size) {
+		if (A->hashes[i] < B->hashes[j]) {
+			i++;
+		} else if (A->hashes[i] > B->hashes[j]) {
+			j++;
+		} else {
+			shared++, i++, j++;
+		}
+	}
+
+	return shared;
+}
+
+/** @brief Frees the memory of a sketch. */
+void sketch_free(sketch_t *self) {
+	free(self->hashes);
+	*self = (sketch_t){};
+}
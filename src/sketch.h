@@ -0,0 +1,30 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the minimizer sketches in
+ * sketch.c.
+ */
+#ifndef _SKETCH_H_
+#define _SKETCH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief A sketch of a sequence.
+ *
+ * A sketch is the set of the hashes of all (w,k)-minimizers of a sequence.
+ * The hashes are sorted and unique.
+ */
+typedef struct sketch_s {
+	/** The minimizer hashes in ascending order. */
+	uint64_t *hashes;
+	/** The number of hashes. */
+	size_t size;
+} sketch_t;
+
+void sketch_params(size_t threshold, size_t *k, size_t *w);
+int sketch_init(sketch_t *, const char *S, size_t len, size_t k, size_t w);
+size_t sketch_shared(const sketch_t *, const sketch_t *);
+void sketch_free(sketch_t *);
+
+#endif // _SKETCH_H_
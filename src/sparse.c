@@ -0,0 +1,550 @@
+/**
+ * @file
+ * @brief Sorting a subset of the suffixes of a text
+ *
+ * A partial index holds only some of the suffixes of the subject. Comparing
+ * them character by character takes time proportional to their common
+ * prefix, which is quadratic in the length of a repeat. Instead, a difference
+ * cover sample of the suffixes is sorted first, as in the construction of
+ * Kärkkäinen, Sanders and Burkhardt (2006): suffixes starting at a position
+ * `q` with `q mod V` in ::COVER. For any two positions i and j there is a
+ * δ < V such that i + δ and j + δ are both sampled. Hence two suffixes are
+ * compared by at most δ characters and the ranks of two sampled suffixes.
+ *
+ * The text is split into blocks of V positions, and only the blocks reached
+ * by the selected suffixes are sampled, that is, those within V characters of
+ * one. Sampled suffixes sharing h characters are told apart by the suffixes h
+ * positions further on. If these lie in a block that is not sampled, the
+ * blocks up to 4h positions further on are added and the sample is sorted
+ * again. Thus, the sample grows with the number of selected suffixes and the
+ * length of the repeats they start in, not with the length of the text.
+ *
+ * The sample is sorted by its first V characters with a radix sort and then
+ * by prefix doubling in steps of V, which keep the sampled residues. Only
+ * suffixes in repeats of V or more characters take part in the doubling,
+ * which takes O(m log m) time for m sampled suffixes in the worst case. The
+ * LCP of two suffixes is found likewise from at most δ characters and the
+ * minimum of the LCP array of the sample between the ranks of the sampled
+ * suffixes. That LCP array is computed per residue as by Kasai et al.
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "rmq.h"
+#include "sparse.h"
+
+/** @brief The period of the difference cover and the size of a block. */
+#define V 64
+
+/** @brief A difference cover modulo ::V: every residue is the difference of
+ * two of its members. */
+static const size_t COVER[] = {0, 1, 2, 5, 14, 16, 34, 42, 59};
+
+/** @brief The number of members of ::COVER. */
+#define COVER_SIZE (sizeof(COVER) / sizeof(*COVER))
+
+/** @brief Fewer values than this are sorted by insertion instead of radix
+ * sort. */
+#define RADIX_CUTOFF 32
+
+/** @brief The sorted difference cover sample of a text. */
+typedef struct sample_s {
+	const char *S;
+	size_t len;
+	/** Bit b is set iff the positions `[b * V, (b + 1) * V)` are sampled. */
+	uint64_t *blocks;
+	/** The number of sampled blocks before every word of `blocks`. */
+	size_t *block_rank;
+	/** The number of words of `blocks`. */
+	size_t num_words;
+	/** The number of sampled suffixes. */
+	size_t size;
+	/** The sampled suffixes in sorted order. */
+	saidx_t *SA;
+	/** The rank of every sampled suffix, see sample_index(). */
+	saidx_t *rank;
+	/** The LCP of every sampled suffix with its predecessor in SA. */
+	saidx_t *LCP;
+	/** The range minima of the LCP. */
+	rmq_t rmq;
+	/** The index of a residue in ::COVER, or -1. */
+	int slot[V];
+	/** `delta[a][b]` is the smallest δ with `a + δ` and `b + δ` in
+		::COVER, modulo ::V. */
+	unsigned char delta[V][V];
+} sample_t;
+
+/** @brief Returns 1 iff the block `b` is sampled. */
+static int block_sampled(const sample_t *self, size_t b) {
+	return self->blocks[b / 64] >> (b % 64) & 1;
+}
+
+/** @brief Samples the blocks of the positions `[a, b)`. */
+static void sample_add(sample_t *self, size_t a, size_t b) {
+	if (b > self->len) b = self->len;
+	for (size_t k = a / V; k * V < b; k++) {
+		self->blocks[k / 64] |= 1ULL << (k % 64);
+	}
+}
+
+/** @brief Returns 1 iff the suffix at `q` is sampled. */
+static int sample_has(const sample_t *self, size_t q) {
+	return q < self->len && self->slot[q % V] >= 0 &&
+		   block_sampled(self, q / V);
+}
+
+/** @brief Returns the index of the sampled position `q` in the ranks. */
+static size_t sample_index(const sample_t *self, size_t q) {
+	size_t b = q / V;
+	uint64_t below = self->blocks[b / 64] & ((1ULL << (b % 64)) - 1);
+	size_t block = self->block_rank[b / 64] + __builtin_popcountll(below);
+	return block * COVER_SIZE + self->slot[q % V];
+}
+
+/** @brief Returns the rank of the sampled position `q`; -1 for the end. */
+static saidx_t sample_rank(const sample_t *self, size_t q) {
+	return q < self->len ? self->rank[sample_index(self, q)] : -1;
+}
+
+/**
+ * @brief Sorts suffixes by their first ::V characters.
+ *
+ * This is an MSD radix sort; small buckets are sorted by insertion.
+ *
+ * @param S - The text; terminated by NUL.
+ * @param A - The suffixes, which share their first `depth` characters.
+ * @param tmp - Room for `n` suffixes.
+ * @param n - The number of suffixes.
+ * @param depth - The number of characters already sorted by.
+ */
+static void radix_sort(const unsigned char *S, saidx_t *A, saidx_t *tmp,
+					   size_t n, size_t depth) {
+	while (n >= RADIX_CUTOFF && depth < V) {
+		saidx_t count[256] = {0};
+		for (size_t k = 0; k < n; k++) {
+			count[S[A[k] + depth]]++;
+		}
+
+		// Suffixes of a repeat all go to one bucket; skip the scatter.
+		if ((size_t)count[S[A[0] + depth]] == n) {
+			depth++;
+			continue;
+		}
+
+		saidx_t next[256], sum = 0;
+		for (size_t c = 0; c < 256; c++) {
+			next[c] = sum;
+			sum += count[c];
+		}
+
+		for (size_t k = 0; k < n; k++) {
+			tmp[next[S[A[k] + depth]]++] = A[k];
+		}
+		memcpy(A, tmp, n * sizeof(*A));
+
+		// At most one suffix ends here, in bucket 0.
+		for (size_t c = 1, a = count[0]; c < 256; a += count[c++]) {
+			radix_sort(S, A + a, tmp, count[c], depth + 1);
+		}
+		return;
+	}
+
+	if (depth >= V) return;
+
+	for (size_t x = 1; x < n; x++) {
+		saidx_t q = A[x];
+		size_t y = x;
+		for (; y > 0 && strncmp((const char *)S + A[y - 1] + depth,
+								(const char *)S + q + depth, V - depth) > 0;
+			 y--) {
+			A[y] = A[y - 1];
+		}
+		A[y] = q;
+	}
+}
+
+/** @brief A sampled suffix with the rank of its successor in a round. */
+typedef struct sort_key_s {
+	saidx_t key, pos;
+} sort_key_t;
+
+/** @brief Sorts keys by an LSD radix sort; few keys are sorted by insertion.
+ */
+static void sort_keys(sort_key_t *keys, sort_key_t *tmp, size_t n) {
+	if (n < RADIX_CUTOFF) {
+		for (size_t x = 1; x < n; x++) {
+			sort_key_t key = keys[x];
+			size_t y = x;
+			for (; y > 0 && keys[y - 1].key > key.key; y--) {
+				keys[y] = keys[y - 1];
+			}
+			keys[y] = key;
+		}
+		return;
+	}
+
+	sort_key_t *from = keys, *to = tmp;
+
+	// Ranks start at -1 for the end of the text.
+	for (unsigned shift = 0; shift < 32; shift += 8) {
+		saidx_t count[256] = {0};
+		for (size_t k = 0; k < n; k++) {
+			count[(uint32_t)(from[k].key + 1) >> shift & 255]++;
+		}
+
+		if ((size_t)count[(uint32_t)(from[0].key + 1) >> shift & 255] == n) {
+			continue;
+		}
+
+		saidx_t next[256], sum = 0;
+		for (size_t c = 0; c < 256; c++) {
+			next[c] = sum;
+			sum += count[c];
+		}
+
+		for (size_t k = 0; k < n; k++) {
+			to[next[(uint32_t)(from[k].key + 1) >> shift & 255]++] = from[k];
+		}
+
+		sort_key_t *swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != keys) memcpy(keys, from, n * sizeof(*keys));
+}
+
+/** @brief Appends a group `[a, b)` of suffixes to a list. */
+static void push_group(size_t **groups, size_t *num, size_t *capacity,
+					   size_t a, size_t b) {
+	if (*num + 2 > *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 1024;
+		*groups = realloc(*groups, *capacity * sizeof(**groups));
+		CHECK_MALLOC(*groups);
+	}
+
+	(*groups)[(*num)++] = a;
+	(*groups)[(*num)++] = b;
+}
+
+/**
+ * @brief Sorts the sample.
+ *
+ * Suffixes with equal prefixes form a group. The rank of a suffix is the
+ * index of the first suffix of its group. In every round, the groups still
+ * holding more than one suffix are sorted by the rank of the suffix h
+ * positions further on and split. Ranks are updated in place, which only
+ * ever refines the order, as in the algorithm of Larsson and Sadakane.
+ *
+ * @returns 1 iff blocks had to be sampled and the sample has to be sorted
+ * again, 0 otherwise.
+ */
+static int sample_sort(sample_t *self) {
+	const char *S = self->S;
+	saidx_t *SA = self->SA;
+	size_t m = self->size;
+
+	// The LCP array is not computed yet and serves as scratch space.
+	radix_sort((const unsigned char *)S, SA, self->LCP, m, 0);
+
+	size_t *groups = NULL, num_groups = 0, capacity = 0;
+	size_t largest = 0;
+
+	for (size_t a = 0; a < m;) {
+		size_t b = a + 1;
+		while (b < m && !strncmp(S + SA[a], S + SA[b], V)) {
+			b++;
+		}
+
+		for (size_t r = a; r < b; r++) {
+			self->rank[sample_index(self, SA[r])] = a;
+		}
+
+		if (b - a > 1) {
+			push_group(&groups, &num_groups, &capacity, a, b);
+			if (b - a > largest) largest = b - a;
+		}
+		a = b;
+	}
+
+	sort_key_t *keys = malloc(2 * largest * sizeof(*keys));
+	if (largest) CHECK_MALLOC(keys);
+
+	size_t *next = NULL, num_next = 0, next_capacity = 0;
+	int grown = 0;
+
+	for (size_t h = V; num_groups; h *= 2) {
+		// The suffixes h positions further on have to be sampled.
+		for (size_t g = 0; g < num_groups; g += 2) {
+			for (size_t r = groups[g]; r < groups[g + 1]; r++) {
+				size_t q = SA[r] + h;
+				if (q < self->len && !block_sampled(self, q / V)) {
+					sample_add(self, q, q + 3 * h);
+					grown = 1;
+				}
+			}
+		}
+
+		if (grown) break;
+
+		num_next = 0;
+
+		for (size_t g = 0; g < num_groups; g += 2) {
+			size_t a = groups[g], n = groups[g + 1] - a;
+
+			for (size_t r = 0; r < n; r++) {
+				saidx_t q = SA[a + r];
+				keys[r] = (sort_key_t){.key = sample_rank(self, q + h),
+									   .pos = q};
+			}
+
+			sort_keys(keys, keys + largest, n);
+
+			for (size_t x = 0; x < n;) {
+				size_t y = x + 1;
+				while (y < n && keys[y].key == keys[x].key) {
+					y++;
+				}
+
+				for (size_t z = x; z < y; z++) {
+					SA[a + z] = keys[z].pos;
+					self->rank[sample_index(self, keys[z].pos)] = a + x;
+				}
+
+				if (y - x > 1) {
+					push_group(&next, &num_next, &next_capacity, a + x,
+							   a + y);
+				}
+				x = y;
+			}
+		}
+
+		size_t *tmp = groups;
+		groups = next;
+		next = tmp;
+		num_groups = num_next;
+		size_t tmp_capacity = capacity;
+		capacity = next_capacity;
+		next_capacity = tmp_capacity;
+	}
+
+	free(keys);
+	free(groups);
+	free(next);
+
+	return grown;
+}
+
+/**
+ * @brief Collects the suffixes of the sampled blocks and sorts them.
+ *
+ * @returns 1 iff blocks had to be sampled and this has to be repeated.
+ */
+static int sample_build(sample_t *self) {
+	size_t num_blocks = 0;
+	for (size_t w = 0; w < self->num_words; w++) {
+		self->block_rank[w] = num_blocks;
+		num_blocks += __builtin_popcountll(self->blocks[w]);
+	}
+
+	size_t slots = num_blocks * COVER_SIZE;
+	self->SA = realloc(self->SA, slots * sizeof(*self->SA));
+	self->rank = realloc(self->rank, slots * sizeof(*self->rank));
+	self->LCP = realloc(self->LCP, slots * sizeof(*self->LCP));
+	CHECK_MALLOC(self->SA);
+	CHECK_MALLOC(self->rank);
+	CHECK_MALLOC(self->LCP);
+
+	size_t k = 0;
+	for (size_t w = 0; w < self->num_words; w++) {
+		for (uint64_t bits = self->blocks[w]; bits; bits &= bits - 1) {
+			size_t q = (w * 64 + __builtin_ctzll(bits)) * V;
+			for (size_t c = 0; c < COVER_SIZE && q + COVER[c] < self->len;
+				 c++) {
+				self->SA[k++] = q + COVER[c];
+			}
+		}
+	}
+	self->size = k;
+
+	return k && sample_sort(self);
+}
+
+/**
+ * @brief Computes the LCP array of the sample.
+ *
+ * Per residue, the sampled suffixes are visited in text order. If suffix q
+ * shares l characters with its predecessor p, suffix q + V shares at least
+ * l - V with p + V, as in the algorithm of Kasai et al. This bound carries
+ * over as long as both p + V and q + V are sampled. Thus each residue takes
+ * time linear in the length of the sampled blocks.
+ */
+static void sample_lcp(sample_t *self) {
+	const char *S = self->S;
+	saidx_t *LCP = self->LCP;
+
+	for (size_t c = 0; c < COVER_SIZE; c++) {
+		size_t l = 0, expected = 0;
+
+		for (size_t w = 0; w < self->num_words; w++) {
+			for (uint64_t bits = self->blocks[w]; bits; bits &= bits - 1) {
+				size_t q = (w * 64 + __builtin_ctzll(bits)) * V + COVER[c];
+				if (q >= self->len) break;
+				if (q != expected) l = 0;
+				expected = q + V;
+
+				saidx_t r = sample_rank(self, q);
+				if (r == 0) {
+					LCP[0] = 0;
+					l = 0;
+					continue;
+				}
+
+				size_t prev = self->SA[r - 1];
+				while (S[q + l] && S[q + l] == S[prev + l]) {
+					l++;
+				}
+
+				LCP[r] = l;
+				l = l > V && sample_has(self, prev + V) ? l - V : 0;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Compares two suffixes of the text.
+ *
+ * @returns A negative value, zero or a positive value if suffix `a` is
+ * smaller than, equal to or larger than suffix `b`.
+ */
+static int cmp_suffix(const void *a, const void *b, void *context) {
+	const sample_t *self = context;
+	size_t i = *(const saidx_t *)a, j = *(const saidx_t *)b;
+	const unsigned char *S = (const unsigned char *)self->S;
+
+	size_t d = self->delta[i % V][j % V];
+	for (size_t l = 0; l < d; l++) {
+		if (S[i + l] != S[j + l]) return S[i + l] - S[j + l];
+	}
+
+	saidx_t x = sample_rank(self, i + d), y = sample_rank(self, j + d);
+	return (x > y) - (x < y);
+}
+
+/** @brief Returns the length of the longest common prefix of two different
+ * suffixes. */
+static size_t sample_lce(const sample_t *self, size_t i, size_t j) {
+	const char *S = self->S;
+	size_t d = self->delta[i % V][j % V];
+
+	for (size_t l = 0; l < d; l++) {
+		if (!S[i + l] || S[i + l] != S[j + l]) return l;
+	}
+
+	if (i + d >= self->len || j + d >= self->len) return d;
+
+	size_t x = sample_rank(self, i + d), y = sample_rank(self, j + d);
+	if (x > y) {
+		size_t tmp = x;
+		x = y;
+		y = tmp;
+	}
+
+	return d + rmq_min(&self->rmq, x + 1, y);
+}
+
+static void sample_free(sample_t *self) {
+	free(self->blocks);
+	free(self->block_rank);
+	free(self->SA);
+	free(self->rank);
+	free(self->LCP);
+	rmq_free(&self->rmq);
+}
+
+/**
+ * @brief Sorts some suffixes of a text and computes their LCP array.
+ *
+ * The suffixes are radix sorted by their first ::V characters. Those sharing
+ * V characters are then sorted by comparing the ranks of two sampled
+ * suffixes each.
+ *
+ * @param S - The text; terminated by NUL.
+ * @param len - The length of the text.
+ * @param SA - The starting positions of the suffixes; sorted in place.
+ * @param LCP - (output parameter) Room for `num + 1` values. As for an ESA,
+ * the first and last value are -1.
+ * @param num - The number of suffixes.
+ * @returns 0 iff successful
+ */
+int sparse_sort(const char *S, size_t len, saidx_t *SA, saidx_t *LCP,
+				size_t num) {
+	if (!S || !SA || !LCP) return 1;
+
+	sample_t sample = {.S = S, .len = len};
+
+	for (size_t r = 0; r < V; r++) {
+		sample.slot[r] = -1;
+	}
+	for (size_t c = 0; c < COVER_SIZE; c++) {
+		sample.slot[COVER[c]] = c;
+	}
+
+	for (size_t a = 0; a < V; a++) {
+		for (size_t b = 0; b < V; b++) {
+			size_t d = 0;
+			while (sample.slot[(a + d) % V] < 0 ||
+				   sample.slot[(b + d) % V] < 0) {
+				d++;
+			}
+			sample.delta[a][b] = d;
+		}
+	}
+
+	sample.num_words = (len + V - 1) / V / 64 + 1;
+	sample.blocks = calloc(sample.num_words, sizeof(*sample.blocks));
+	sample.block_rank = malloc(sample.num_words * sizeof(*sample.block_rank));
+	CHECK_MALLOC(sample.blocks);
+	CHECK_MALLOC(sample.block_rank);
+
+	for (size_t r = 0; r < num; r++) {
+		sample_add(&sample, SA[r], SA[r] + V);
+	}
+
+	while (sample_build(&sample)) {
+	}
+
+	if (sample.size) {
+		sample_lcp(&sample);
+		rmq_init(&sample.rmq, sample.LCP, sample.size);
+	}
+
+	// The LCP array is filled last and serves as scratch space.
+	radix_sort((const unsigned char *)S, SA, LCP, num, 0);
+
+	for (size_t a = 0; a < num;) {
+		size_t b = a + 1;
+		while (b < num && !strncmp(S + SA[a], S + SA[b], V)) {
+			b++;
+		}
+
+		if (b - a > 1) {
+			qsort_r(SA + a, b - a, sizeof(*SA), cmp_suffix, &sample);
+		}
+		a = b;
+	}
+
+	LCP[0] = -1;
+	LCP[num] = -1;
+	for (size_t r = 1; r < num; r++) {
+		LCP[r] = sample_lce(&sample, SA[r - 1], SA[r]);
+	}
+
+	sample_free(&sample);
+
+	return 0;
+}
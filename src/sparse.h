@@ -0,0 +1,15 @@
+/**
+ * @file
+ * @brief This header contains the declarations for sorting a subset of the
+ * suffixes of a text in sparse.c.
+ */
+#ifndef _SPARSE_H_
+#define _SPARSE_H_
+
+#include <stdlib.h>
+#include "esa.h"
+
+int sparse_sort(const char *S, size_t len, saidx_t *SA, saidx_t *LCP,
+				size_t num);
+
+#endif // _SPARSE_H_
@@ -0,0 +1,219 @@
+/**
+ * @file
+ * @brief An on-disk cache of indices
+ *
+ * Repeated runs against the same reference spend most of their time building
+ * the very same index. With `--index-cache DIR`, a full index is saved to DIR
+ * after it was built and loaded on later runs instead of building it again.
+ *
+ * The file name is a hash of the subject and all parameters that determine
+ * the saved arrays: the alphabet, the depth of the LCP-interval cache and
+ * whether it is filled lazily (then it is not saved), the width of the SA
+ * entries and the format version (which implies no compression). Each use of
+ * an entry updates its modification time. After storing a new entry, the
+ * least recently used entries are evicted until the directory holds at most
+ * ::INDEX_CACHE_SIZE bytes.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esa.h"
+#include "global.h"
+#include "hash.h"
+#include "io.h"
+#include "store.h"
+
+/** @brief The version of the format; part of the key. */
+static const uint64_t STORE_VERSION = 3;
+
+/** @brief The file name extension of cache entries. */
+static const char STORE_EXT[] = ".idx";
+
+/** @brief Hashes the subject and the index parameters. */
+static uint64_t store_key(const seq_t *S) {
+	uint64_t hash = mix64(STORE_VERSION);
+	const alphabet_t *alphabet = esa_alphabet();
+	hash = mix64(hash ^ alphabet->size);
+	hash = mix64(hash ^ esa_cache_length(alphabet));
+	hash = mix64(hash ^ !!(FLAGS & F_LAZY_CACHE));
+	hash = mix64(hash ^ sizeof(saidx_t));
+	hash = mix64(hash ^ S->RSlen);
+
+	const char *str = S->RS;
+	size_t len = S->RSlen;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t word;
+		memcpy(&word, str + i, sizeof(word));
+		hash = mix64(hash ^ word);
+	}
+
+	uint64_t word = 0;
+	memcpy(&word, str + i, len - i);
+	return mix64(hash ^ word);
+}
+
+/** @brief Returns the path of the cache entry for a subject. */
+static char *store_path(const seq_t *S) {
+	char *path = NULL;
+	if (asprintf(&path, "%s/%016llx%s", INDEX_CACHE,
+				 (unsigned long long)store_key(S), STORE_EXT) < 0) {
+		err(errno, "asprintf");
+	}
+	return path;
+}
+
+/**
+ * @brief Loads the index of a subject from the cache.
+ *
+ * @param C - The ESA to initialize.
+ * @param S - The subject.
+ * @returns 0 iff the index was found and loaded.
+ */
+int store_load(esa_s *C, const seq_t *S) {
+	char *path = store_path(S);
+	FILE *file = fopen(path, "rb");
+	int check = 1;
+
+	if (file) {
+		check = esa_load(C, S, file);
+		fclose(file);
+	}
+
+	if (check == 0) {
+		// mark as recently used
+		utimensat(AT_FDCWD, path, NULL, 0);
+	}
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Index cache %s: %s\n", check ? "miss" : "hit", path);
+	}
+
+	free(path);
+	return check;
+}
+
+/** @brief A cache entry considered for eviction. */
+typedef struct entry_s {
+	char *path;
+	off_t size;
+	struct timespec mtime;
+} entry_t;
+
+/** @brief Orders entries from least to most recently used. */
+static int cmp_mtime(const void *a, const void *b) {
+	const struct timespec *x = &((const entry_t *)a)->mtime;
+	const struct timespec *y = &((const entry_t *)b)->mtime;
+
+	if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/** @brief Removes the least recently used entries until the cache fits into
+ * ::INDEX_CACHE_SIZE. */
+static void store_evict(void) {
+	DIR *dir = opendir(INDEX_CACHE);
+	if (!dir) return;
+
+	entry_t *entries = NULL;
+	size_t num_entries = 0, capacity = 0;
+	off_t total = 0;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		size_t len = strlen(ent->d_name);
+		size_t ext_len = sizeof(STORE_EXT) - 1;
+		if (len <= ext_len || strcmp(ent->d_name + len - ext_len, STORE_EXT)) {
+			continue;
+		}
+
+		char *path = NULL;
+		if (asprintf(&path, "%s/%s", INDEX_CACHE, ent->d_name) < 0) {
+			err(errno, "asprintf");
+		}
+
+		struct stat st;
+		if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+			free(path);
+			continue;
+		}
+
+		if (num_entries == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			entries = reallocarray(entries, capacity, sizeof(*entries));
+			CHECK_MALLOC(entries);
+		}
+
+		entries[num_entries++] = (entry_t){
+			.path = path, .size = st.st_size, .mtime = st.st_mtim};
+		total += st.st_size;
+	}
+
+	closedir(dir);
+
+	qsort(entries, num_entries, sizeof(*entries), cmp_mtime);
+
+	for (size_t i = 0; i < num_entries; i++) {
+		if ((size_t)total > INDEX_CACHE_SIZE && unlink(entries[i].path) == 0) {
+			total -= entries[i].size;
+
+			if (FLAGS & F_VERBOSE) {
+				fprintf(stderr, "Index cache: evicted %s\n", entries[i].path);
+			}
+		}
+		free(entries[i].path);
+	}
+
+	free(entries);
+}
+
+/**
+ * @brief Saves the index of a subject to the cache.
+ *
+ * The index is written to a temporary file first and then renamed. Thus
+ * concurrent runs never see a partial entry. Failures are reported but not
+ * fatal.
+ *
+ * @param C - The ESA.
+ * @param S - The subject.
+ */
+void store_save(const esa_s *C, const seq_t *S) {
+	char *path = store_path(S);
+	char *tmp = NULL;
+	if (asprintf(&tmp, "%s.%ld.tmp", path, (long)getpid()) < 0) {
+		err(errno, "asprintf");
+	}
+
+	FILE *file = fopen(tmp, "wb");
+	if (!file) {
+		warn("%s", tmp);
+		goto fail;
+	}
+
+	int check = esa_save(C, file);
+	check |= fclose(file);
+
+	if (check || rename(tmp, path)) {
+		warnx("Failed to store the index in %s.", path);
+		unlink(tmp);
+		goto fail;
+	}
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Index cache: stored %s\n", path);
+	}
+
+	store_evict();
+
+fail:
+	free(tmp);
+	free(path);
+}
@@ -0,0 +1,15 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the on-disk index cache in
+ * store.c.
+ */
+#ifndef _STORE_H_
+#define _STORE_H_
+
+#include "esa.h"
+#include "sequence.h"
+
+int store_load(esa_s *, const seq_t *S);
+void store_save(const esa_s *, const seq_t *S);
+
+#endif // _STORE_H_
@@ -26,9 +26,11 @@
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include "global.h"
 #include "process.h"
@@ -41,12 +43,59 @@
 
 /* Global variables */
 int FLAGS = F_FORWARD;
+int NON_ACGT = 0;
 int THREADS = 1;
 double RANDOM_ANCHOR_PROP = 0.05;
 int MIN_LENGTH = 0;
+FILE *QUERY_STATS = NULL;
+FILE *SUS_FILE = NULL;
+FILE *MATCHING_STATS = NULL;
+int WORKERS = 0;
+int BRIDGE = 0;
+size_t TOP = 0;
+const char *DOTPLOT = NULL;
+size_t DOTPLOT_BINS = 1000;
+const char *OUTPUT_DIR = NULL;
+const char **OUTPUT_FILES = NULL;
+const char *SHM_NAME = NULL;
+const char *METRICS_ADDRESS = NULL;
+const char *INDEX_CACHE = NULL;
+size_t INDEX_CACHE_SIZE = (size_t)4 << 30;
+size_t CACHE_DEPTH = 0;
+
+/** Identifiers for options that only have a long form. */
+enum {
+	OPT_QUERY_STATS = 256,
+	OPT_WORKERS,
+	OPT_SKETCH,
+	OPT_BLOOM,
+	OPT_PARTIAL,
+	OPT_SUS,
+	OPT_MATCHING_STATS,
+	OPT_BRIDGE,
+	OPT_OUTPUT_DIR,
+	OPT_DELTA,
+	OPT_INDEX_CACHE,
+	OPT_INDEX_CACHE_SIZE,
+	OPT_MANIFEST,
+	OPT_SHM,
+	OPT_METRICS,
+	OPT_PROTEIN,
+	OPT_LAZY_CACHE,
+	OPT_CACHE_DEPTH,
+	OPT_TOP,
+	OPT_DOTPLOT,
+	OPT_DOTPLOT_BINS,
+	OPT_WIDE_FVC,
+	OPT_RINDEX,
+	OPT_DROP_TEXT,
+};
 
 void usage(void);
 void version(void);
+static void read_file(const char *file_name, dsa_t *dsa);
+static void read_manifest_files(const manifest_entry_t *entries,
+								size_t num_entries, dsa_t *dsa);
 
 /**
  * @brief The main function.
@@ -58,6 +107,7 @@ void version(void);
 int main(int argc, char *argv[]) {
 	int c;
 	int version_flag = 0;
+	const char *manifest_file = NULL;
 
 	struct option long_options[] = {
 		{"version", no_argument, &version_flag, 1},
@@ -65,7 +115,33 @@ int main(int argc, char *argv[]) {
 		{"verbose", no_argument, NULL, 'v'},
 		{"join", no_argument, NULL, 'j'},
 		{"min-length", required_argument, NULL, 'l'},
-		// {"threads", required_argument, NULL, 't'},
+		{"query-stats", required_argument, NULL, OPT_QUERY_STATS},
+		{"workers", required_argument, NULL, OPT_WORKERS},
+		{"sketch", no_argument, NULL, OPT_SKETCH},
+		{"bloom", no_argument, NULL, OPT_BLOOM},
+		{"partial-index", no_argument, NULL, OPT_PARTIAL},
+		{"sus", required_argument, NULL, OPT_SUS},
+		{"matching-stats", required_argument, NULL, OPT_MATCHING_STATS},
+		{"bridge", required_argument, NULL, OPT_BRIDGE},
+		{"output-dir", required_argument, NULL, OPT_OUTPUT_DIR},
+		{"delta", no_argument, NULL, OPT_DELTA},
+		{"index-cache", required_argument, NULL, OPT_INDEX_CACHE},
+		{"index-cache-size", required_argument, NULL, OPT_INDEX_CACHE_SIZE},
+		{"manifest", required_argument, NULL, OPT_MANIFEST},
+		{"shm", required_argument, NULL, OPT_SHM},
+		{"protein", no_argument, NULL, OPT_PROTEIN},
+		{"metrics", required_argument, NULL, OPT_METRICS},
+		{"lazy-cache", no_argument, NULL, OPT_LAZY_CACHE},
+		{"wide-fvc", no_argument, NULL, OPT_WIDE_FVC},
+		{"r-index", no_argument, NULL, OPT_RINDEX},
+		{"drop-text", no_argument, NULL, OPT_DROP_TEXT},
+		{"cache-depth", required_argument, NULL, OPT_CACHE_DEPTH},
+		{"top", required_argument, NULL, OPT_TOP},
+		{"dotplot", required_argument, NULL, OPT_DOTPLOT},
+		{"dotplot-bins", required_argument, NULL, OPT_DOTPLOT_BINS},
+#ifdef _OPENMP
+		{"threads", required_argument, NULL, 't'},
+#endif
 		{0, 0, 0, 0}};
 
 #ifdef _OPENMP
@@ -78,7 +154,7 @@ int main(int argc, char *argv[]) {
 
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "bhjrvp:l:m:", long_options, &option_index);
+		c = getopt_long(argc, argv, "bhjrvp:l:m:t:", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -134,6 +210,196 @@ int main(int argc, char *argv[]) {
 				MIN_LENGTH = length;
 				break;
 			}
+			case OPT_QUERY_STATS: {
+				if (QUERY_STATS && QUERY_STATS != stdout) {
+					fclose(QUERY_STATS);
+				}
+
+				QUERY_STATS = strcmp(optarg, "-") ? fopen(optarg, "w") : stdout;
+				if (!QUERY_STATS) {
+					err(errno, "%s", optarg);
+				}
+				break;
+			}
+			case OPT_SKETCH: FLAGS |= F_SKETCH; break;
+			case OPT_BLOOM: FLAGS |= F_BLOOM; break;
+			case OPT_PARTIAL: FLAGS |= F_PARTIAL; break;
+			case OPT_DELTA: FLAGS |= F_DELTA; break;
+			case OPT_PROTEIN: FLAGS |= F_PROTEIN; break;
+			case OPT_LAZY_CACHE: FLAGS |= F_LAZY_CACHE; break;
+			case OPT_WIDE_FVC: FLAGS |= F_WIDE_FVC; break;
+			case OPT_RINDEX: FLAGS |= F_RINDEX; break;
+			case OPT_DROP_TEXT: FLAGS |= F_DROP_TEXT; break;
+			case OPT_CACHE_DEPTH: {
+				errno = 0;
+				char *end;
+				long unsigned int depth = strtoul(optarg, &end, 10);
+
+				if (errno || end == optarg || *end != '\0' || depth == 0) {
+					warnx("Expected a positive number for --cache-depth, but "
+						  "'%s' was given. Ignoring argument.",
+						  optarg);
+					break;
+				}
+
+				CACHE_DEPTH = depth;
+				break;
+			}
+			case OPT_MATCHING_STATS: {
+				if (MATCHING_STATS && MATCHING_STATS != stdout) {
+					fclose(MATCHING_STATS);
+				}
+
+				MATCHING_STATS =
+					strcmp(optarg, "-") ? fopen(optarg, "wb") : stdout;
+				if (!MATCHING_STATS) {
+					err(errno, "%s", optarg);
+				}
+				break;
+			}
+			case OPT_SUS: {
+				if (SUS_FILE && SUS_FILE != stdout) {
+					fclose(SUS_FILE);
+				}
+
+				SUS_FILE = strcmp(optarg, "-") ? fopen(optarg, "w") : stdout;
+				if (!SUS_FILE) {
+					err(errno, "%s", optarg);
+				}
+				break;
+			}
+#ifdef _OPENMP
+			case 't': {
+				errno = 0;
+				char *end;
+				long unsigned int threads = strtoul(optarg, &end, 10);
+
+				if (errno || end == optarg || *end != '\0' || threads == 0) {
+					warnx("Expected a positive number for -t argument, but "
+						  "'%s' was given. Ignoring -t argument.",
+						  optarg);
+					break;
+				}
+
+				THREADS = threads;
+				break;
+			}
+#endif
+			case OPT_WORKERS: {
+				errno = 0;
+				char *end;
+				long unsigned int workers = strtoul(optarg, &end, 10);
+
+				if (errno || end == optarg || *end != '\0' || workers > 1024) {
+					warnx("Expected a number of workers, but '%s' was given. "
+						  "Ignoring --workers argument.",
+						  optarg);
+					break;
+				}
+
+				WORKERS = workers;
+				break;
+			}
+			case OPT_OUTPUT_DIR: {
+				if (mkdir(optarg, 0777) && errno != EEXIST) {
+					err(errno, "%s", optarg);
+				}
+
+				OUTPUT_DIR = optarg;
+				break;
+			}
+			case OPT_MANIFEST: manifest_file = optarg; break;
+			case OPT_METRICS: METRICS_ADDRESS = optarg; break;
+			case OPT_SHM: {
+				if (optarg[0] != '/' || strchr(optarg + 1, '/')) {
+					errx(1, "The name for --shm has to start with a slash and "
+							"contain no other, e.g. /tummer.");
+				}
+
+				SHM_NAME = optarg;
+				break;
+			}
+			case OPT_INDEX_CACHE: {
+				if (mkdir(optarg, 0777) && errno != EEXIST) {
+					err(errno, "%s", optarg);
+				}
+
+				INDEX_CACHE = optarg;
+				break;
+			}
+			case OPT_INDEX_CACHE_SIZE: {
+				errno = 0;
+				char *end;
+				long unsigned int size = strtoul(optarg, &end, 10);
+				int shift = 0;
+
+				switch (*end) {
+					case 'K': shift = 10; break;
+					case 'M': shift = 20; break;
+					case 'G': shift = 30; break;
+				}
+				if (shift) end++;
+
+				if (errno || end == optarg || *end != '\0' ||
+					size > (SIZE_MAX >> shift)) {
+					warnx("Expected a size like 512M for --index-cache-size, "
+						  "but '%s' was given. Ignoring argument.",
+						  optarg);
+					break;
+				}
+
+				INDEX_CACHE_SIZE = (size_t)size << shift;
+				break;
+			}
+			case OPT_BRIDGE: {
+				errno = 0;
+				char *end;
+				long unsigned int mismatches = strtoul(optarg, &end, 10);
+
+				if (errno || end == optarg || *end != '\0' ||
+					mismatches > INT_MAX) {
+					warnx("Expected a number of mismatches, but '%s' was "
+						  "given. Ignoring --bridge argument.",
+						  optarg);
+					break;
+				}
+
+				BRIDGE = mismatches;
+				break;
+			}
+			case OPT_TOP: {
+				errno = 0;
+				char *end;
+				long unsigned int top = strtoul(optarg, &end, 10);
+
+				if (errno || end == optarg || *end != '\0' || top == 0) {
+					warnx("Expected a positive number for --top, but '%s' was "
+						  "given. Ignoring argument.",
+						  optarg);
+					break;
+				}
+
+				TOP = top;
+				break;
+			}
+			case OPT_DOTPLOT: DOTPLOT = optarg; break;
+			case OPT_DOTPLOT_BINS: {
+				errno = 0;
+				char *end;
+				long unsigned int bins = strtoul(optarg, &end, 10);
+
+				if (errno || end == optarg || *end != '\0' || bins == 0 ||
+					bins > 65536) {
+					warnx("Expected a number of bins between 1 and 65536 for "
+						  "--dotplot-bins, but '%s' was given. Ignoring "
+						  "argument.",
+						  optarg);
+					break;
+				}
+
+				DOTPLOT_BINS = bins;
+				break;
+			}
 			case 'm': {
 				// legacy MUMmer options
 				if (strcmp("umcand", optarg) == 0 ||
@@ -162,8 +428,64 @@ int main(int argc, char *argv[]) {
 	argc -= optind;
 	argv += optind;
 
+	if (FLAGS & F_PROTEIN) {
+		if (FLAGS & F_REVCOMP) {
+			errx(1, "Proteins have no reverse complement; -b and -r cannot "
+					"be combined with --protein.");
+		}
+
+		if (FLAGS & (F_BLOOM | F_SKETCH | F_PARTIAL | F_WIDE_FVC)) {
+			errx(1, "--bloom, --sketch, --partial-index and --wide-fvc work "
+					"on nucleotides only and cannot be combined with "
+					"--protein.");
+		}
+	}
+
+	// The cache has 2^(bits * depth) entries of 16 bytes.
+	const alphabet_t *alphabet = esa_alphabet();
+	if (alphabet->bits * esa_cache_length(alphabet) > 32) {
+		errx(1, "A --cache-depth of %zu is too deep; at most %zu is supported "
+				"for %s.",
+			 CACHE_DEPTH, 32 / alphabet->bits,
+			 FLAGS & F_PROTEIN ? "proteins" : "nucleotides");
+	}
+
+	if (TOP && (MATCHING_STATS || SHM_NAME)) {
+		errx(1, "--top cannot be combined with --matching-stats or --shm.");
+	}
+
+	if (DOTPLOT && (TOP || MATCHING_STATS || SHM_NAME || OUTPUT_DIR ||
+					manifest_file)) {
+		errx(1, "--dotplot cannot be combined with --top, --matching-stats, "
+				"--shm, --output-dir or --manifest.");
+	}
+
+	if (FLAGS & F_RINDEX &&
+		(FLAGS & (F_DELTA | F_PARTIAL | F_LAZY_CACHE | F_WIDE_FVC) ||
+		 CACHE_DEPTH || MATCHING_STATS || SUS_FILE || INDEX_CACHE)) {
+		errx(1, "--r-index cannot be combined with --delta, --partial-index, "
+				"--lazy-cache, --wide-fvc, --cache-depth, --matching-stats, "
+				"--sus or --index-cache.");
+	}
+
+	if (FLAGS & F_DROP_TEXT && (!(FLAGS & F_RINDEX) || BRIDGE)) {
+		errx(1, "--drop-text requires --r-index and cannot be combined with "
+				"--bridge.");
+	}
+
+	if (manifest_file) {
+		if (argc) {
+			errx(1, "With --manifest no further files may be given.");
+		}
+
+		if (OUTPUT_DIR || MATCHING_STATS) {
+			errx(1, "--manifest cannot be combined with --output-dir or "
+					"--matching-stats.");
+		}
+	}
+
 	// at least one file name must be given
-	if (FLAGS & F_JOIN && argc == 0) {
+	if (FLAGS & F_JOIN && argc == 0 && !manifest_file) {
 		errx(1, "In join mode at least one filename needs to be supplied.");
 	}
 
@@ -174,28 +496,43 @@ int main(int argc, char *argv[]) {
 
 	const char *file_name;
 
-	// parse all files
-	int minfiles = FLAGS & F_JOIN ? 2 : 1;
-	for (;; minfiles--) {
-		if (!*argv) {
-			if (minfiles <= 0) break;
-
-			// if no files are supplied, read from stdin
-			file_name = "-";
-		} else {
-			file_name = *argv++;
-		}
+	manifest_entry_t *entries = NULL;
+	size_t num_entries = 0;
+
+	/* Parse all files. As soon as the subject has been read, its index is
+	 * built in the background; see prepare_subject(). */
+	if (manifest_file) {
+		entries = read_manifest(manifest_file, &num_entries);
+		read_manifest_files(entries, num_entries, &dsa);
+	} else {
+		int minfiles = FLAGS & F_JOIN && !SHM_NAME ? 2 : 1;
+		for (;; minfiles--) {
+			if (!*argv) {
+				if (minfiles <= 0) break;
+
+				// if no files are supplied, read from stdin
+				file_name = "-";
+			} else {
+				file_name = *argv++;
+			}
 
-		if (FLAGS & F_JOIN) {
-			read_fasta_join(file_name, &dsa);
-		} else {
-			read_fasta(file_name, &dsa);
+			read_file(file_name, &dsa);
 		}
 	}
 
 	size_t n = dsa_size(&dsa);
 
-	if (n < 2) {
+	if (METRICS_ADDRESS && !SHM_NAME) {
+		errx(1, "--metrics requires --shm.");
+	}
+
+	if (SHM_NAME && (n != 1 || manifest_file || MATCHING_STATS ||
+					 FLAGS & F_PARTIAL)) {
+		errx(1, "With --shm exactly one reference and no queries, manifest, "
+				"--matching-stats or --partial-index may be given.");
+	}
+
+	if (n < 2 && !SHM_NAME) {
 		errx(1,
 			 "I am truly sorry, but with less than two sequences (%zu given) "
 			 "there is nothing to compare.",
@@ -203,7 +540,10 @@ int main(int argc, char *argv[]) {
 	}
 
 	// Warn about non ACGT residues.
-	if (FLAGS & F_NON_ACGT) {
+	if (NON_ACGT && FLAGS & F_PROTEIN) {
+		warnx("The input sequences contained characters other than the 20 "
+			  "amino acids. These were mapped to X to ensure correct results.");
+	} else if (NON_ACGT) {
 		warnx("The input sequences contained characters other than acgtACGT. "
 			  "These were mapped to N to ensure correct results.");
 	}
@@ -212,9 +552,10 @@ int main(int argc, char *argv[]) {
 	const seq_t *seq = dsa_data(&dsa);
 	for (size_t i = 0; i < n; ++i, ++seq) {
 
-		// The length limit should only apply to the reference
+		// The length limit should only apply to the reference; the r-index
+		// has none.
 		const size_t LENGTH_LIMIT = (INT_MAX - 1) / 2;
-		if (seq->len > LENGTH_LIMIT) {
+		if (!(FLAGS & F_RINDEX) && seq->len > LENGTH_LIMIT) {
 			errx(1, "The sequence %s is too long. The technical limit is %zu.",
 				 seq->name, LENGTH_LIMIT);
 		}
@@ -230,10 +571,86 @@ int main(int argc, char *argv[]) {
 
 	run(dsa_data(&dsa), n);
 
+	if (QUERY_STATS && QUERY_STATS != stdout) {
+		fclose(QUERY_STATS);
+	}
+
+	if (SUS_FILE && SUS_FILE != stdout) {
+		fclose(SUS_FILE);
+	}
+
+	if (MATCHING_STATS && MATCHING_STATS != stdout) {
+		fclose(MATCHING_STATS);
+	}
+
 	dsa_free(&dsa);
+	free(OUTPUT_FILES);
+	manifest_free(entries, num_entries);
 	return 0;
 }
 
+/**
+ * @brief Reads the sequences of a FASTA file.
+ */
+static void read_file(const char *file_name, dsa_t *dsa) {
+	if (FLAGS & F_JOIN) {
+		read_fasta_join(file_name, dsa, prepare_subject);
+	} else {
+		read_fasta(file_name, dsa, prepare_subject);
+	}
+}
+
+/**
+ * @brief Reads the files listed in a manifest and sets ::OUTPUT_FILES.
+ *
+ * Every output file is truncated here once; query_output() appends to it.
+ * Thus several sequences of one query file share its output.
+ *
+ * @param entries - The manifest.
+ * @param num_entries - The number of entries.
+ * @param dsa - (output parameter) An array that holds found sequences.
+ */
+static void read_manifest_files(const manifest_entry_t *entries,
+								size_t num_entries, dsa_t *dsa) {
+	size_t capacity = 64;
+	OUTPUT_FILES = malloc(capacity * sizeof(*OUTPUT_FILES));
+	CHECK_MALLOC(OUTPUT_FILES);
+
+	for (size_t i = 0; i < num_entries; i++) {
+		size_t before = dsa_size(dsa);
+		read_file(entries[i].path, dsa);
+		size_t after = dsa_size(dsa);
+
+		if (i == 0) {
+			if (after != 1) {
+				errx(1, "The reference %s has to contain exactly one sequence; "
+						"use -j to join several.",
+					 entries[i].path);
+			}
+
+			OUTPUT_FILES[0] = NULL;
+			continue;
+		}
+
+		FILE *file = fopen(entries[i].output, "w");
+		if (!file) {
+			err(errno, "%s", entries[i].output);
+		}
+		fclose(file);
+
+		if (after > capacity) {
+			capacity = after * 2;
+			OUTPUT_FILES =
+				realloc(OUTPUT_FILES, capacity * sizeof(*OUTPUT_FILES));
+			CHECK_MALLOC(OUTPUT_FILES);
+		}
+
+		for (size_t j = before; j < after; j++) {
+			OUTPUT_FILES[j] = entries[i].output;
+		}
+	}
+}
+
 /**
  * Prints the usage to stdout and then exits successfully.
  */
@@ -251,9 +668,59 @@ void usage(void) {
 		"  -l, --min-length <INT>  Minimum length of a MUM; uses p-value by "
 		"default\n"
 		"  -p <FLOAT>        Significance of a MUM; default: 0.05\n"
+		"      --bridge <INT>  Merge collinear MUMs separated by at most INT "
+		"mismatches\n"
+		"      --delta       Reuse lookups of the previous, similar query\n"
+		"      --bloom       Stop scanning a query where no reference k-mer "
+		"follows\n"
+		"      --sketch      Skip queries sharing no minimizer with the "
+		"reference\n"
+		"      --cache-depth <INT>  Prefix length up to which LCP-intervals "
+		"are cached; default: 10 (DNA), 4 (proteins)\n"
+		"      --lazy-cache  Fill the LCP-interval cache on first use instead "
+		"of up front\n"
+		"      --wide-fvc    Keep the next nucleotides of every suffix next to "
+		"the index to avoid text accesses; needs 8 more bytes per base\n"
+		"      --r-index     Use a run-length compressed index; smaller for "
+		"references of many similar genomes, but slower\n"
+		"      --drop-text   With --r-index, free the reference once it is "
+		"indexed; slower still\n"
+		"      --index-cache <DIR>  Load and store the index in the cache "
+		"directory DIR\n"
+		"      --index-cache-size <SIZE>  Maximum size of the index cache, "
+		"e.g. 512M; default: 4G\n"
+		"      --metrics <ADDR>  With --shm, serve metrics on the Unix socket "
+		"or loopback port ADDR\n"
+		"      --manifest <FILE>  Read the reference, the queries and their "
+		"output files from FILE\n"
+		"      --top <INT>   Print only the INT longest MUMs per query and "
+		"strand\n"
+		"      --dotplot <FILE>  Write a dot plot of all MUMs to FILE instead "
+		"of the MUMs; a PGM image if FILE ends in .pgm, a matrix otherwise\n"
+		"      --dotplot-bins <INT>  Number of bins per axis of the dot plot; "
+		"default: 1000\n"
+		"      --output-dir <DIR>  Write the output for each query to its own "
+		"file in DIR\n"
+		"      --protein     Compare protein sequences instead of DNA\n"
+		"      --partial-index  Index only reference suffixes starting with "
+		"a query k-mer\n"
+		"      --matching-stats <FILE>  Write the matching statistics of all "
+		"queries to FILE instead of MUMs\n"
+		"      --sus <FILE>  Write the shortest unique substring length of "
+		"every reference position to FILE\n"
+		"      --query-stats <FILE>  Write a performance record per query "
+		"and strand to FILE\n"
+		"      --shm <NAME>  Serve queries via the shared memory segment NAME "
+		"instead of reading them from files\n"
 		"  -r                Compute only reverse complement matches; default: "
 		"forward only\n"
+#ifdef _OPENMP
+		"  -t, --threads <INT>  The number of threads to be used; by default, "
+		"all available processors are used\n"
+#endif
 		"  -v, --verbose     Prints additional information\n"
+		"      --workers <INT>  Distribute the queries over INT worker "
+		"processes\n"
 		"  -h, --help        Display this help and exit\n"
 		"      --version     Output version information\n"};
 
@@ -0,0 +1,533 @@
+/**
+ * @file
+ * @brief A differential verifier and benchmark for the index engines
+ *
+ * TUMmer has alternative code paths which must give the same results: the
+ * suffix sorter it was built with versus a plain comparison sort, lookups with
+ * and without the LCP-interval cache, filled up front or lazily, with and
+ * without the FVW, an index built in memory versus one stored in the index
+ * cache and loaded again, and a partial index. `tummer-verify` runs a
+ * reference and a query through each of these engines in a child process of
+ * its own. The index is built by subject_init() and the queries are scanned
+ * by query_anchors(), just as by TUMmer; a sink records every MUM. The MUMs
+ * of all engines are compared against those of the first one. Next to the
+ * verdict, the time to build the index and to scan the queries as well as the
+ * peak memory are reported per engine.
+ *
+ * New engines are added to ::ENGINES.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esa.h"
+#include "global.h"
+#include "io.h"
+#include "process.h"
+#include "sequence.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Global variables */
+int FLAGS = F_FORWARD;
+int NON_ACGT = 0;
+int THREADS = 1;
+double RANDOM_ANCHOR_PROP = 0.05;
+int MIN_LENGTH = 0;
+FILE *QUERY_STATS = NULL;
+FILE *SUS_FILE = NULL;
+FILE *MATCHING_STATS = NULL;
+int WORKERS = 0;
+int BRIDGE = 0;
+size_t TOP = 0;
+const char *DOTPLOT = NULL;
+size_t DOTPLOT_BINS = 1000;
+const char *OUTPUT_DIR = NULL;
+const char **OUTPUT_FILES = NULL;
+const char *SHM_NAME = NULL;
+const char *METRICS_ADDRESS = NULL;
+const char *INDEX_CACHE = NULL;
+size_t INDEX_CACHE_SIZE = (size_t)4 << 30;
+size_t CACHE_DEPTH = 0;
+
+#ifdef HAVE_LIBDIVSUFSORT
+#define SORTER_NAME "divsufsort"
+#else
+#define SORTER_NAME "psufsort"
+#endif
+
+/** @brief One way to build an index and look up matches. */
+typedef struct engine_s {
+	const char *name;
+	esa_sorter_t sorter;
+	/** Iff set, the index is stored in an index cache and loaded again. */
+	int reload;
+	/** Iff set, lookups start from the root instead of the cache. */
+	int uncached;
+	/** Flags in addition to the global ones. */
+	int flags;
+} engine_t;
+
+/** @brief All engines. The first one is the reference for the others. */
+static const engine_t ENGINES[] = {
+	{SORTER_NAME "+cached", ESA_SA_DEFAULT, 0, 0, 0},
+	{SORTER_NAME "+uncached", ESA_SA_DEFAULT, 0, 1, 0},
+	{SORTER_NAME "+lazy", ESA_SA_DEFAULT, 0, 0, F_LAZY_CACHE},
+	{SORTER_NAME "+widefvc", ESA_SA_DEFAULT, 0, 0, F_WIDE_FVC},
+	{SORTER_NAME "+reloaded", ESA_SA_DEFAULT, 1, 0, 0},
+	{"sparse+partial", ESA_SA_DEFAULT, 0, 0, F_PARTIAL},
+	{"r-index", ESA_SA_DEFAULT, 0, 0, F_RINDEX},
+	{"r-index+notext", ESA_SA_DEFAULT, 0, 0, F_RINDEX | F_DROP_TEXT},
+	{"qsort+cached", ESA_SA_QSORT, 0, 0, 0},
+};
+
+/** @brief The flags of engines which only work for DNA. */
+#define DNA_ONLY (F_WIDE_FVC | F_PARTIAL)
+
+#define NUM_ENGINES (sizeof(ENGINES) / sizeof(ENGINES[0]))
+
+/** @brief What the parent learns about a run of an engine. */
+typedef struct result_s {
+	/** The file holding the MUMs. */
+	char path[64];
+	double build, scan, wall;
+	/** The peak resident set size in KiB. */
+	long max_rss;
+	/** Iff set, the child finished successfully. */
+	int done;
+	/** Iff set, the engine does not apply to the alphabet. */
+	int skipped;
+} result_t;
+
+void usage(void);
+
+/** @brief Returns the wall time in seconds. */
+static double wall_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** @brief Reads the sequences of a FASTA file. */
+static void read_file(const char *file_name, dsa_t *dsa) {
+	if (FLAGS & F_JOIN) {
+		read_fasta_join(file_name, dsa, NULL);
+	} else {
+		read_fasta(file_name, dsa, NULL);
+	}
+}
+
+/** @brief Records a MUM as a candidate. */
+static void record_anchor(anchor_sink_t *sink, const anchor_t *anchor) {
+	fprintf(sink->out, "%zu\t%zu\t%zu\n", anchor->pos_S, anchor->pos_Q,
+			anchor->length);
+}
+
+/** @brief Removes an index cache directory and its entries. */
+static void remove_cache(const char *path) {
+	DIR *dir = opendir(path);
+	if (!dir) return;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.') continue;
+
+		char *file;
+		if (asprintf(&file, "%s/%s", path, ent->d_name) < 0) {
+			err(errno, "asprintf");
+		}
+		unlink(file);
+		free(file);
+	}
+
+	closedir(dir);
+	rmdir(path);
+}
+
+/**
+ * @brief Runs an engine; called in a child process.
+ *
+ * The MUMs are written to `out`; the build and scan times to `timing_fd`.
+ *
+ * @returns 0 iff successful.
+ */
+static int run_engine(const engine_t *engine, const char *reference,
+					  const char *query_file, FILE *out, int timing_fd) {
+	FLAGS |= engine->flags;
+
+	dsa_t subjects, queries;
+	dsa_init(&subjects);
+	dsa_init(&queries);
+
+	read_file(reference, &subjects);
+	read_file(query_file, &queries);
+
+	if (dsa_size(&subjects) == 0 || dsa_size(&queries) == 0) {
+		warnx("No sequences to compare.");
+		return 1;
+	}
+
+	seq_t *subject = dsa_data(&subjects);
+	const seq_t *first = dsa_data(&queries);
+	size_t num_queries = dsa_size(&queries);
+
+	subject_t I;
+	char cache[64] = "";
+
+	// The first run fills the index cache, the second one loads from it.
+	if (engine->reload) {
+		const char *dir = getenv("TMPDIR");
+		snprintf(cache, sizeof(cache), "%s/tummer-verify-XXXXXX",
+				 dir && strlen(dir) < 32 ? dir : "/tmp");
+		if (!mkdtemp(cache)) err(errno, "%s", cache);
+
+		INDEX_CACHE = cache;
+		if (subject_init(&I, subject, first, num_queries)) return 1;
+		subject_free(&I);
+	}
+
+	double start = wall_time();
+	if (subject_init(&I, subject, first, num_queries)) return 1;
+
+	// subject_init() always uses the default sorter; only the rebuild counts.
+	if (engine->sorter != ESA_SA_DEFAULT) {
+		esa_free(&I.E);
+		start = wall_time();
+		if (esa_init_with(&I.E, subject, engine->sorter)) return 1;
+	}
+
+	if (engine->uncached) {
+		free(I.E.cache);
+		I.E.cache = NULL;
+	}
+
+	double built = wall_time();
+
+	anchor_sink_t sink = {.push = record_anchor, .out = out};
+	const seq_t *query = first;
+	for (size_t i = 0; i < num_queries; i++, query++) {
+		if (FLAGS & F_FORWARD) {
+			fprintf(out, "> %s\n", query->name);
+			query_anchors(&I, query->S, query->len, &sink);
+		}
+
+		if (FLAGS & F_REVCOMP) {
+			char *R = revcomp(query->S, query->len);
+			fprintf(out, "> %s Reverse\n", query->name);
+			query_anchors(&I, R, query->len, &sink);
+			free(R);
+		}
+	}
+
+	double scanned = wall_time();
+
+	double times[2] = {built - start, scanned - built};
+	if (write(timing_fd, times, sizeof(times)) != sizeof(times)) return 1;
+
+	subject_free(&I);
+	if (cache[0]) remove_cache(cache);
+	dsa_free(&subjects);
+	dsa_free(&queries);
+	return fclose(out);
+}
+
+/** @brief Runs an engine in a child process and waits for it. */
+static void spawn_engine(const engine_t *engine, const char *reference,
+						 const char *query_file, result_t *result) {
+	const char *dir = getenv("TMPDIR");
+	snprintf(result->path, sizeof(result->path), "%s/tummer-verify-XXXXXX",
+			 dir && strlen(dir) < 32 ? dir : "/tmp");
+
+	int fd = mkstemp(result->path);
+	int timing[2];
+	if (fd < 0 || pipe(timing)) {
+		err(errno, "%s", result->path);
+	}
+
+	fflush(NULL);
+	double start = wall_time();
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		err(errno, "fork");
+	}
+
+	if (pid == 0) {
+		close(timing[0]);
+		FILE *out = fdopen(fd, "w");
+		int check = !out || run_engine(engine, reference, query_file, out,
+									   timing[1]);
+		_exit(check ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	close(fd);
+	close(timing[1]);
+
+	double times[2];
+	ssize_t check = read(timing[0], times, sizeof(times));
+	close(timing[0]);
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) < 0) {
+		err(errno, "wait4");
+	}
+
+	result->wall = wall_time() - start;
+	result->max_rss = usage.ru_maxrss;
+	result->done = check == sizeof(times) && WIFEXITED(status) &&
+				   WEXITSTATUS(status) == EXIT_SUCCESS;
+
+	if (result->done) {
+		result->build = times[0];
+		result->scan = times[1];
+	}
+}
+
+/**
+ * @brief Compares two files of MUMs line by line.
+ *
+ * @returns 0 if both are equal; otherwise the number of the first differing
+ * line, which is printed to stderr.
+ */
+static size_t compare_mums(const char *name, const char *path_a,
+								 const char *path_b) {
+	FILE *a = fopen(path_a, "r");
+	FILE *b = fopen(path_b, "r");
+	if (!a || !b) {
+		err(errno, "fopen");
+	}
+
+	char *line_a = NULL, *line_b = NULL;
+	size_t cap_a = 0, cap_b = 0;
+	size_t line = 0;
+	size_t diff = 0;
+
+	for (;;) {
+		ssize_t len_a = getline(&line_a, &cap_a, a);
+		ssize_t len_b = getline(&line_b, &cap_b, b);
+		line++;
+
+		if (len_a < 0 && len_b < 0) break;
+
+		if (len_a < 0 || len_b < 0 || strcmp(line_a, line_b)) {
+			fprintf(stderr, "%s differs in line %zu:\n  %s: %s  %s: %s", name,
+					line, ENGINES[0].name, len_a < 0 ? "(end)\n" : line_a,
+					name, len_b < 0 ? "(end)\n" : line_b);
+			diff = line;
+			break;
+		}
+	}
+
+	free(line_a);
+	free(line_b);
+	fclose(a);
+	fclose(b);
+	return diff;
+}
+
+int main(int argc, char *argv[]) {
+	int selected[NUM_ENGINES] = {0};
+	int any_selected = 0;
+
+	struct option long_options[] = {{"help", no_argument, NULL, 'h'},
+									{"join", no_argument, NULL, 'j'},
+									{"min-length", required_argument, NULL,
+									 'l'},
+									{"engine", required_argument, NULL, 'e'},
+									{"protein", no_argument, NULL, 'P'},
+									{"cache-depth", required_argument, NULL,
+									 'd'},
+#ifdef _OPENMP
+									{"threads", required_argument, NULL, 't'},
+#endif
+									{0, 0, 0, 0}};
+
+#ifdef _OPENMP
+	THREADS = omp_get_num_procs();
+#endif
+
+	int c;
+	while ((c = getopt_long(argc, argv, "bhjl:re:t:", long_options, NULL)) !=
+		   -1) {
+		switch (c) {
+			case 'b': FLAGS |= F_FORWARD | F_REVCOMP; break;
+			case 'j': FLAGS |= F_JOIN; break;
+			case 'r':
+				FLAGS &= ~F_FORWARD;
+				FLAGS |= F_REVCOMP;
+				break;
+			case 'l': {
+				char *end;
+				errno = 0;
+				long int min_length = strtol(optarg, &end, 10);
+				if (errno || end == optarg || *end != '\0' || min_length <= 0 ||
+					min_length > INT_MAX) {
+					errx(1, "Expected a positive number for -l, but '%s' was "
+							"given.",
+						 optarg);
+				}
+				MIN_LENGTH = min_length;
+				break;
+			}
+			case 'P': FLAGS |= F_PROTEIN; break;
+			case 'd': {
+				char *end;
+				errno = 0;
+				long unsigned int depth = strtoul(optarg, &end, 10);
+				if (errno || end == optarg || *end != '\0' || depth == 0) {
+					errx(1, "Expected a positive number for --cache-depth, but "
+							"'%s' was given.",
+						 optarg);
+				}
+				CACHE_DEPTH = depth;
+				break;
+			}
+			case 'e': {
+				size_t k = 0;
+				while (k < NUM_ENGINES && strcmp(ENGINES[k].name, optarg)) {
+					k++;
+				}
+
+				if (k == NUM_ENGINES) {
+					errx(1, "Unknown engine %s.", optarg);
+				}
+
+				selected[k] = any_selected = 1;
+				break;
+			}
+#ifdef _OPENMP
+			case 't': {
+				char *end;
+				errno = 0;
+				long unsigned int threads = strtoul(optarg, &end, 10);
+				if (errno || end == optarg || *end != '\0' || threads == 0) {
+					errx(1, "Expected a positive number for -t, but '%s' was "
+							"given.",
+						 optarg);
+				}
+				THREADS = threads;
+				break;
+			}
+#endif
+			case 'h': /* intentional fall-through */
+			default: usage(); break;
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage();
+	}
+
+	if (FLAGS & F_PROTEIN && FLAGS & F_REVCOMP) {
+		errx(1, "Proteins have no reverse complement.");
+	}
+
+	const alphabet_t *alphabet = esa_alphabet();
+	if (alphabet->bits * esa_cache_length(alphabet) > 32) {
+		errx(1, "A --cache-depth of %zu is too deep.", CACHE_DEPTH);
+	}
+
+	const char *reference = argv[optind];
+	const char *query_file = argv[optind + 1];
+
+	// The first engine is always run as it serves as the reference.
+	selected[0] = 1;
+
+	result_t results[NUM_ENGINES] = {};
+	for (size_t k = 0; k < NUM_ENGINES; k++) {
+		if (any_selected && !selected[k]) continue;
+
+		if (FLAGS & F_PROTEIN && ENGINES[k].flags & DNA_ONLY) {
+			results[k].skipped = 1;
+			continue;
+		}
+
+		spawn_engine(&ENGINES[k], reference, query_file, &results[k]);
+	}
+
+	if (!results[0].done) {
+		errx(1, "The reference engine %s failed.", ENGINES[0].name);
+	}
+
+	printf("%-24s %10s %10s %10s %12s  %s\n", "engine", "build[s]", "scan[s]",
+		   "wall[s]", "maxrss[MiB]", "result");
+
+	int failures = 0;
+	for (size_t k = 0; k < NUM_ENGINES; k++) {
+		result_t *r = &results[k];
+		if (any_selected && !selected[k]) continue;
+
+		const char *verdict = "reference";
+		if (r->skipped) {
+			printf("%-24s %10s %10s %10s %12s  %s\n", ENGINES[k].name, "-",
+				   "-", "-", "-", "skipped");
+			continue;
+		} else if (!r->done) {
+			verdict = "FAILED";
+		} else if (k > 0 && compare_mums(ENGINES[k].name,
+											   results[0].path, r->path)) {
+			verdict = "DIFFERS";
+		} else if (k > 0) {
+			verdict = "identical";
+		}
+
+		failures += !r->done || (k > 0 && strcmp(verdict, "identical"));
+
+		printf("%-24s %10.3f %10.3f %10.3f %12.1f  %s\n", ENGINES[k].name,
+			   r->build, r->scan, r->wall, r->max_rss / 1024.0, verdict);
+	}
+
+	for (size_t k = 0; k < NUM_ENGINES; k++) {
+		if (results[k].path[0]) unlink(results[k].path);
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Prints the usage to stdout and then exits successfully.
+ */
+void usage(void) {
+	const char str[] = {
+		"Usage: tummer-verify [-bjr] [-l INT] [-e ENGINE]... REFERENCE "
+		"QUERIES\n"
+		"\tRuns the reference and queries through every engine, compares "
+		"the MUMs and reports time and memory per engine.\n"
+		"Options:\n"
+		"  -b                Scan forward and reverse complement; default: "
+		"forward only\n"
+		"      --cache-depth <INT>  Prefix length up to which LCP-intervals "
+		"are cached\n"
+		"  -e, --engine <NAME>  Run only this engine besides the first; may be "
+		"repeated\n"
+		"  -j, --join        Treat all sequences from one file as a single "
+		"genome\n"
+		"  -l, --min-length <INT>  Minimum length of a MUM; uses p-value by "
+		"default\n"
+		"      --protein     Compare protein sequences instead of DNA\n"
+		"  -r                Scan only the reverse complement\n"
+#ifdef _OPENMP
+		"  -t, --threads <INT>  The number of threads for sorting suffixes\n"
+#endif
+		"  -h, --help        Display this help and exit\n"
+		"Engines:\n"
+		"  " SORTER_NAME "+cached, " SORTER_NAME "+uncached, " SORTER_NAME
+		"+lazy, " SORTER_NAME "+widefvc, " SORTER_NAME "+reloaded, "
+		"sparse+partial, r-index, qsort+cached\n"};
+
+	printf("%s", str);
+	exit(EXIT_SUCCESS);
+}
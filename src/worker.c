@@ -0,0 +1,336 @@
+/**
+ * @file
+ * @brief Coordinator/worker mode
+ *
+ * In this mode the queries are distributed over several worker processes.
+ * The workers are forked right after the index of the subject was built. Thus
+ * they all attach to the very same index via shared copy-on-write pages
+ * instead of building their own.
+ *
+ * The coordinator talks to each worker via two pipes. A task is simply the
+ * index of a query. The worker answers with a ::reply_t header followed by the
+ * MUMs and the performance records of that query. With `--output-dir`, the MUMs
+ * are written to the query's own file instead. With `--manifest`, the
+ * coordinator appends them to the output file of the query, which may be shared
+ * by several queries. With `--dotplot`, the output consists of the dot plot
+ * cells touched by the query, which the coordinator merges into its own. Tasks
+ * are assigned dynamically whenever a worker becomes idle. If a worker dies,
+ * its task is queued again and a new worker is spawned. Replies are buffered
+ * and printed in query order, so the output is the same as with a single
+ * process.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "dotplot.h"
+#include "global.h"
+#include "process.h"
+#include "worker.h"
+
+/** @brief The number of times a task may fail before giving up. */
+static const int MAX_ATTEMPTS = 3;
+
+/** @brief The header of a reply from a worker. */
+typedef struct reply_s {
+	/** The task (query index) this reply belongs to. */
+	uint64_t task;
+	/** The number of bytes of MUM output following the header. */
+	uint64_t out_len;
+	/** The number of bytes of performance records following the output. */
+	uint64_t stats_len;
+} reply_t;
+
+/** @brief The coordinators view of a worker process. */
+typedef struct worker_s {
+	pid_t pid;
+	/** The write end of the task pipe. */
+	int cmd;
+	/** The read end of the reply pipe. */
+	int res;
+	/** The task currently assigned, or -1 if idle. */
+	ssize_t task;
+} worker_t;
+
+/** @brief The buffered result of a task. */
+typedef struct result_s {
+	char *out, *stats;
+	size_t out_len, stats_len;
+	int done;
+	int attempts;
+} result_t;
+
+/** @brief Writes exactly `len` bytes. Returns 0 iff successful. */
+static int write_all(int fd, const void *buf, size_t len) {
+	const char *ptr = buf;
+	while (len) {
+		ssize_t check = write(fd, ptr, len);
+		if (check < 0 && errno == EINTR) continue;
+		if (check <= 0) return -1;
+		ptr += check;
+		len -= check;
+	}
+	return 0;
+}
+
+/** @brief Reads exactly `len` bytes. Returns 0 iff successful. */
+static int read_all(int fd, void *buf, size_t len) {
+	char *ptr = buf;
+	while (len) {
+		ssize_t check = read(fd, ptr, len);
+		if (check < 0 && errno == EINTR) continue;
+		if (check <= 0) return -1;
+		ptr += check;
+		len -= check;
+	}
+	return 0;
+}
+
+/**
+ * @brief The main loop of a worker process.
+ *
+ * Reads query indices until the task pipe is closed and answers each with the
+ * output of compare_query(). The performance records carry the number of the
+ * worker, counting from 1. This function never returns.
+ */
+static void worker_main(const subject_t *I, const seq_t *sequences, int cmd,
+						int res, int number) {
+	uint64_t task;
+
+	while (read_all(cmd, &task, sizeof(task)) == 0) {
+		reply_t reply = {.task = task};
+		char *out = NULL, *stats = NULL;
+		size_t out_len = 0, stats_len = 0;
+
+		// With an output directory, the worker writes the file on its own.
+		FILE *out_file = OUTPUT_DIR ? query_output(task, "w")
+									: open_memstream(&out, &out_len);
+		FILE *stats_file = QUERY_STATS ? open_memstream(&stats, &stats_len)
+									   : NULL;
+		if (!out_file || (QUERY_STATS && !stats_file)) {
+			_exit(EXIT_FAILURE);
+		}
+
+		compare_query(I, &sequences[task], out_file, stats_file, number);
+		if (DOTPLOT) dotplot_flush(out_file);
+
+		fclose(out_file);
+		if (stats_file) fclose(stats_file);
+
+		reply.out_len = out_len;
+		reply.stats_len = stats_len;
+
+		int check = write_all(res, &reply, sizeof(reply)) ||
+					write_all(res, out, out_len) ||
+					write_all(res, stats, stats_len);
+
+		free(out);
+		free(stats);
+
+		if (check) _exit(EXIT_FAILURE);
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Forks a new worker process.
+ *
+ * The child closes the pipes to all other workers, so these see the end of
+ * their task pipe once the coordinator closes it.
+ */
+static void spawn_worker(worker_t *workers, size_t num_workers, worker_t *w,
+						 const subject_t *I, const seq_t *sequences) {
+	int cmd[2], res[2];
+	if (pipe(cmd) || pipe(res)) {
+		err(errno, "pipe");
+	}
+
+	// Buffered output must not be written by both processes.
+	fflush(NULL);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		err(errno, "fork");
+	}
+
+	if (pid == 0) {
+		for (size_t k = 0; k < num_workers; k++) {
+			if (&workers[k] == w || workers[k].pid <= 0) continue;
+			close(workers[k].cmd);
+			close(workers[k].res);
+		}
+
+		close(cmd[1]);
+		close(res[0]);
+		worker_main(I, sequences, cmd[0], res[1], w - workers + 1);
+	}
+
+	close(cmd[0]);
+	close(res[1]);
+
+	*w = (worker_t){.pid = pid, .cmd = cmd[1], .res = res[0], .task = -1};
+}
+
+/** @brief Closes the pipes of a worker and reaps it. */
+static void reap_worker(worker_t *w) {
+	close(w->cmd);
+	close(w->res);
+	waitpid(w->pid, NULL, 0);
+	w->pid = 0;
+	w->task = -1;
+}
+
+/** @brief Reads the reply to the current task of a worker. */
+static int receive_reply(worker_t *w, result_t *results) {
+	reply_t reply;
+	if (read_all(w->res, &reply, sizeof(reply))) return -1;
+	if ((ssize_t)reply.task != w->task) return -1;
+
+	result_t *r = &results[w->task];
+
+	r->out = malloc(reply.out_len + 1);
+	r->stats = malloc(reply.stats_len + 1);
+	CHECK_MALLOC(r->out);
+	CHECK_MALLOC(r->stats);
+
+	if (read_all(w->res, r->out, reply.out_len) ||
+		read_all(w->res, r->stats, reply.stats_len)) {
+		free(r->out);
+		free(r->stats);
+		r->out = r->stats = NULL;
+		return -1;
+	}
+
+	r->out_len = reply.out_len;
+	r->stats_len = reply.stats_len;
+	r->done = 1;
+	return 0;
+}
+
+/**
+ * @brief Compares all queries to the subject using ::WORKERS processes.
+ *
+ * @param I - The subject and its index.
+ * @param sequences - An array of all sequences. The first one is the subject.
+ * @param n - The number of sequences.
+ * @param out - The stream to print the merged output to.
+ */
+void run_workers(const subject_t *I, seq_t *sequences, size_t n, FILE *out) {
+	size_t num_tasks = n - 1;
+	size_t num_workers =
+		(size_t)WORKERS < num_tasks ? (size_t)WORKERS : num_tasks;
+
+	result_t *results = calloc(n, sizeof(*results));
+	worker_t *workers = calloc(num_workers, sizeof(*workers));
+	// pending tasks form a stack; the next task is on top.
+	size_t *pending = malloc(n * sizeof(*pending));
+	struct pollfd *fds = malloc(num_workers * sizeof(*fds));
+	CHECK_MALLOC(results);
+	CHECK_MALLOC(workers);
+	CHECK_MALLOC(pending);
+	CHECK_MALLOC(fds);
+
+	size_t num_pending = 0;
+	for (size_t j = n - 1; j > 0; j--) {
+		pending[num_pending++] = j;
+	}
+
+	// A dying worker must not kill the coordinator.
+	signal(SIGPIPE, SIG_IGN);
+
+	for (size_t k = 0; k < num_workers; k++) {
+		spawn_worker(workers, num_workers, &workers[k], I, sequences);
+	}
+
+	size_t next_out = 1;
+	while (next_out < n) {
+		// hand out tasks to idle workers
+		for (size_t k = 0; k < num_workers && num_pending; k++) {
+			worker_t *w = &workers[k];
+			if (w->task >= 0) continue;
+
+			uint64_t task = pending[--num_pending];
+			w->task = task;
+
+			if (FLAGS & F_EXTRA_VERBOSE) {
+				fprintf(stderr, "worker %d: comparing 0 and %zu\n", (int)w->pid,
+						(size_t)task);
+			}
+
+			// A failed write is detected as a failed reply below.
+			write_all(w->cmd, &task, sizeof(task));
+		}
+
+		nfds_t num_fds = 0;
+		for (size_t k = 0; k < num_workers; k++) {
+			fds[k] = (struct pollfd){.fd = -1};
+			if (workers[k].task < 0) continue;
+			fds[k] = (struct pollfd){.fd = workers[k].res, .events = POLLIN};
+			num_fds = k + 1;
+		}
+
+		if (poll(fds, num_fds, -1) < 0) {
+			if (errno == EINTR) continue;
+			err(errno, "poll");
+		}
+
+		for (size_t k = 0; k < num_fds; k++) {
+			worker_t *w = &workers[k];
+			if (fds[k].fd < 0 || !fds[k].revents) continue;
+
+			if (receive_reply(w, results) == 0) {
+				w->task = -1;
+				continue;
+			}
+
+			// The worker died. Queue its task again and replace it.
+			ssize_t task = w->task;
+			warnx("Worker %d failed on %s; retrying.", (int)w->pid,
+				  sequences[task].name);
+
+			reap_worker(w);
+			if (++results[task].attempts >= MAX_ATTEMPTS) {
+				errx(1, "Giving up on %s after %d attempts.",
+					 sequences[task].name, MAX_ATTEMPTS);
+			}
+
+			pending[num_pending++] = task;
+			spawn_worker(workers, num_workers, w, I, sequences);
+		}
+
+		// merge the finished results in order
+		while (next_out < n && results[next_out].done) {
+			result_t *r = &results[next_out];
+			if (DOTPLOT) {
+				dotplot_merge(r->out, r->out_len);
+			} else {
+				FILE *query_out =
+					OUTPUT_FILES ? query_output(next_out, "w") : out;
+				fwrite(r->out, 1, r->out_len, query_out);
+				if (OUTPUT_FILES) fclose(query_out);
+			}
+			next_out++;
+			if (QUERY_STATS) fwrite(r->stats, 1, r->stats_len, QUERY_STATS);
+			free(r->out);
+			free(r->stats);
+		}
+	}
+
+	for (size_t k = 0; k < num_workers; k++) {
+		reap_worker(&workers[k]);
+	}
+
+	free(fds);
+	free(pending);
+	free(workers);
+	free(results);
+}
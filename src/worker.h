@@ -0,0 +1,15 @@
+/**
+ * @file
+ * @brief This header contains the declarations for the coordinator/worker
+ * mode in worker.c.
+ */
+#ifndef _WORKER_H_
+#define _WORKER_H_
+
+#include <stdio.h>
+#include "process.h"
+#include "sequence.h"
+
+void run_workers(const subject_t *I, seq_t *sequences, size_t n, FILE *out);
+
+#endif // _WORKER_H_